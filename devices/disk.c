@@ -48,6 +48,10 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ or WRITE SECTOR command transfers.  The
+   sector count register holds 0 for this many. */
+#define MAX_MULTIPLE 256
+
 /* An ATA device. */
 struct disk {
 	char name[8];               /* Name, e.g. "hd0:1". */
@@ -84,7 +88,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -206,21 +210,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-	
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_read_multiple (d, sec_no, &buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -230,23 +220,80 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multiple (d, sec_no, &buffer, 1);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D, sector I
+   into BUFFERS[I], each of which must have room for
+   DISK_SECTOR_SIZE bytes.  Issues one command for up to
+   MAX_MULTIPLE sectors at a time. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no,
+		void *const buffers[], size_t cnt) {
 	struct channel *c;
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (buffers != NULL);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	while (cnt > 0) {
+		size_t n = cnt < MAX_MULTIPLE ? cnt : MAX_MULTIPLE;
+		size_t i;
+
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			input_sector (c, buffers[i]);
+		}
+		d->read_cnt += n;
+		sec_no += n;
+		buffers += n;
+		cnt -= n;
+	}
 	lock_release (&c->lock);
 }
-
+
+/* Writes the CNT sectors starting at SEC_NO to disk D, sector I
+   from BUFFERS[I], each of which must contain DISK_SECTOR_SIZE
+   bytes.  Issues one command for up to MAX_MULTIPLE sectors at a
+   time, and returns after the disk has acknowledged receiving all
+   of the data. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *const buffers[], size_t cnt) {
+	struct channel *c;
+
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t n = cnt < MAX_MULTIPLE ? cnt : MAX_MULTIPLE;
+		size_t i;
+
+		select_sector (d, sec_no, n);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+		for (i = 0; i < n; i++) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			output_sector (c, buffers[i]);
+			sema_down (&c->completion_wait);
+		}
+		d->write_cnt += n;
+		sec_no += n;
+		buffers += n;
+		cnt -= n;
+	}
+	lock_release (&c->lock);
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -399,17 +446,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and count
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= MAX_MULTIPLE);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == MAX_MULTIPLE ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
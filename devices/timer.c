@@ -7,6 +7,8 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "intrinsic.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,39 +19,113 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency, and the counter value that yields one
+   interrupt every 1/TIMER_FREQ second. */
+#define PIT_HZ 1193180
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot period the 16-bit counter can express. */
+#define PIT_MAX_ONESHOT_TICKS (0xffff / PIT_TICK_COUNT)
+
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_TICK (NS_PER_SEC / TIMER_FREQ)
+
+/* Milliseconds over which the TSC is calibrated against PIT
+   counter 2 when CPUID does not report its frequency. */
+#define TSC_CALIBRATE_MS 10
+
+/* TSC cycles are converted to nanoseconds as
+   (cycles * tsc_mult) >> TSC_SHIFT. */
+#define TSC_SHIFT 32
+
+/* CMOS real-time clock, used as the high-resolution event
+   source.  Its periodic interrupt runs at 32768 >> (RTC_RATE - 1)
+   Hz, here 8192 Hz, for a resolution of about 122 us. */
+#define RTC_INDEX 0x70              /* Register select, bit 7 masks NMI. */
+#define RTC_DATA 0x71
+#define RTC_REG_A 0x8a
+#define RTC_REG_B 0x8b
+#define RTC_REG_C 0x8c
+#define RTC_B_PIE 0x40              /* Register B: periodic interrupt enable. */
+#define RTC_RATE 3
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
-//struct semaphore sema_sleep;
-//static int64_t num_sleeping;
-struct list sleep_list;
+/* If true, the idle thread programs the PIT in one-shot mode
+   for the next deadline instead of taking every tick.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Length of the one-shot period in progress, in ticks, or 0 if
+   the PIT is in periodic mode. */
+static int64_t oneshot_ticks;
+
+/* Pending timers, in a heap ordered by deadline, so that arming
+   one costs O(1) however many are pending.  The interrupt handler
+   only ever looks at the minimum. */
+static struct pheap timer_queue;
+
+/* Pending high-resolution timers, ordered by deadline in
+   nanoseconds.  The RTC periodic interrupt is on while this heap
+   is not empty. */
+static struct pheap hrtimer_queue;
+
+/* Timers armed so far, to fire equal deadlines in FIFO order. */
+static uint64_t timer_seq;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* TSC clock source, set up by timer_calibrate().  Until then
+   tsc_mult is 0 and timer_ns() counts whole ticks. */
+static uint64_t tsc_hz;             /* TSC cycles per second. */
+static uint64_t tsc_mult;           /* ns per cycle, scaled by TSC_SHIFT. */
+static uint64_t tsc_base;           /* TSC at time NS_BASE. */
+static int64_t ns_base;             /* timer_ns() at TSC_BASE. */
+
+/* High-resolution statistics. */
+static long long hrtimer_cnt;       /* # of hrtimers fired. */
+static long long rtc_interrupt_cnt; /* # of RTC interrupts taken. */
+
 static intr_handler_func timer_interrupt;
+static intr_handler_func rtc_interrupt;
 static bool too_many_loops (unsigned loops);
+static uint64_t tsc_cpuid_hz (void);
+static uint64_t tsc_pit_hz (void);
+static void tsc_calibrate (void);
+static bool deadline_less (const struct pheap_elem *,
+		const struct pheap_elem *, void *aux);
+static void hrtimer_run (void);
+static void rtc_set_periodic (bool on);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void pit_program (uint8_t mode, uint16_t count);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void
 timer_init (void) {
+	uint8_t rtc_a;
+
 	/* 8254 input frequency divided by TIMER_FREQ, rounded to
 	   nearest. */
-	//sema_init(&sema_sleep,0);
-	//num_sleeping=0;
-	list_init(&sleep_list);
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	pheap_init (&timer_queue, deadline_less, NULL);
+	pheap_init (&hrtimer_queue, deadline_less, NULL);
+	pit_program (2, PIT_TICK_COUNT);
 
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+
+	/* Select the RTC's periodic rate but leave its interrupt off
+	   until a high-resolution timer is armed. */
+	outb (RTC_INDEX, RTC_REG_A);
+	rtc_a = inb (RTC_DATA);
+	outb (RTC_INDEX, RTC_REG_A);
+	outb (RTC_DATA, (rtc_a & 0xf0) | RTC_RATE);
+	rtc_set_periodic (false);
+	intr_register_ext (0x28, rtc_interrupt, "RTC");
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -75,6 +151,100 @@ timer_calibrate (void) {
 			loops_per_tick |= test_bit;
 
 	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+	tsc_calibrate ();
+}
+
+/* Returns the TSC frequency in Hz as reported by CPUID leaf
+   0x15 (TSC/crystal ratio) or 0x16 (base frequency), or 0 if
+   the CPU reports neither. */
+static uint64_t
+tsc_cpuid_hz (void) {
+	uint32_t regs[4];
+	uint32_t max_leaf;
+
+	cpuid (0, regs);
+	max_leaf = regs[0];
+	if (max_leaf >= 0x15) {
+		cpuid (0x15, regs);
+		if (regs[0] != 0 && regs[1] != 0 && regs[2] != 0)
+			return (uint64_t) regs[2] * regs[1] / regs[0];
+	}
+	if (max_leaf >= 0x16) {
+		cpuid (0x16, regs);
+		if ((regs[0] & 0xffff) != 0)
+			return (uint64_t) (regs[0] & 0xffff) * 1000000;
+	}
+	return 0;
+}
+
+/* Measures the TSC rate over a TSC_CALIBRATE_MS one-shot of PIT
+   counter 2, which leaves counter 0 and the timer tick alone. */
+static uint64_t
+tsc_pit_hz (void) {
+	uint16_t count = PIT_HZ * TSC_CALIBRATE_MS / 1000;
+	uint64_t start_tsc, end_tsc;
+	uint8_t port61;
+
+	/* Gate counter 2 on, with the speaker off. */
+	port61 = inb (0x61);
+	outb (0x61, (port61 & ~0x02) | 0x01);
+
+	/* CW: counter 2, LSB then MSB, mode 0, binary.  OUT goes low
+	   now and rises once COUNT has elapsed. */
+	outb (0x43, 0xb0);
+	outb (0x42, count & 0xff);
+	outb (0x42, count >> 8);
+
+	start_tsc = rdtsc ();
+	while (!(inb (0x61) & 0x20))
+		continue;
+	end_tsc = rdtsc ();
+
+	outb (0x61, port61);
+	return (end_tsc - start_tsc) * 1000 / TSC_CALIBRATE_MS;
+}
+
+/* Determines the TSC rate and switches timer_ns() over to the
+   TSC.  Assumes an invariant TSC, which every CPU QEMU emulates
+   has. */
+static void
+tsc_calibrate (void) {
+	enum intr_level old_level;
+	uint16_t remaining;
+	uint64_t hz;
+
+	hz = tsc_cpuid_hz ();
+	if (hz == 0)
+		hz = tsc_pit_hz ();
+
+	/* Start the TSC clock at the current position within the
+	   running tick, so that timer_ns() never goes backward. */
+	old_level = intr_disable ();
+	outb (0x43, 0x00);    /* CW: latch counter 0. */
+	remaining = inb (0x40);
+	remaining |= inb (0x40) << 8;
+	tsc_base = rdtsc ();
+	ns_base = ticks * NS_PER_TICK
+		+ (int64_t) (PIT_TICK_COUNT - remaining) * NS_PER_SEC / PIT_HZ;
+	tsc_hz = hz;
+	tsc_mult = ((uint64_t) NS_PER_SEC << TSC_SHIFT) / tsc_hz;
+	intr_set_level (old_level);
+}
+
+/* Returns the number of nanoseconds since the OS booted.  Once
+   the timer is calibrated this reads the TSC, so it has far
+   finer resolution than timer_ticks() and keeps counting while a
+   tickless CPU sleeps. */
+int64_t
+timer_ns (void) {
+	uint64_t mult = tsc_mult;
+
+	if (mult == 0)
+		return timer_ticks () * NS_PER_TICK;
+	return ns_base
+		+ (int64_t) (((unsigned __int128) (rdtsc () - tsc_base) * mult)
+				>> TSC_SHIFT);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -94,21 +264,158 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
+/* Timer callback that wakes up the sleeping thread AUX. */
+static void
+wake_sleeper (struct timer *timer UNUSED, void *aux) {
+	struct thread *t = aux;
+
+	TRACE (TRACE_WAKE, t->tid, 0);
+	thread_unblock (t);
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void
 timer_sleep (int64_t ticks) {
 	int64_t start = timer_ticks ();
+	struct timer alarm = { .pending = false };
 	enum intr_level old_level;
 
 	ASSERT (intr_get_level () == INTR_ON);
 	
 	old_level=intr_disable();
-	thread_current()->sleep_time = start+ticks;
-	list_push_back(&sleep_list,&thread_current()->elem);
+	TRACE (TRACE_SLEEP, thread_current ()->tid, ticks);
+	timer_add (&alarm, start + ticks, wake_sleeper, thread_current ());
 	thread_block();
 	intr_set_level(old_level);
 }
 
+/* Timer callback that wakes up the sleeping thread AUX from a
+   high-resolution timer, preempting the interrupted thread if
+   the sleeper outranks it. */
+static void
+wake_hr_sleeper (struct timer *timer UNUSED, void *aux) {
+	struct thread *t = aux;
+
+	TRACE (TRACE_WAKE, t->tid, 0);
+	thread_unblock (t);
+	if (t->priority > thread_current ()->priority)
+		intr_yield_on_return ();
+}
+
+/* Suspends execution for approximately NS nanoseconds, blocking
+   on a high-resolution timer. */
+static void
+hr_sleep (int64_t ns) {
+	struct timer alarm = { .pending = false };
+	enum intr_level old_level;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	if (ns <= 0)
+		return;
+
+	old_level = intr_disable ();
+	TRACE (TRACE_SLEEP, thread_current ()->tid, 0);
+	timer_add_ns (&alarm, timer_ns () + ns, wake_hr_sleeper,
+			thread_current ());
+	thread_block ();
+	intr_set_level (old_level);
+}
+
+/* Orders timers by deadline; equal deadlines fire in FIFO order. */
+static bool
+deadline_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct timer *a = pheap_entry (a_, struct timer, elem);
+	const struct timer *b = pheap_entry (b_, struct timer, elem);
+
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+	return a->seq < b->seq;
+}
+
+/* Arms TIMER, which must not be pending, on QUEUE.  Interrupts
+   must be off. */
+static void
+timer_enqueue (struct pheap *queue, struct timer *timer, int64_t deadline,
+		timer_func *func, void *aux) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!timer->pending);
+
+	timer->deadline = deadline;
+	timer->func = func;
+	timer->aux = aux;
+	timer->pending = true;
+	timer->queue = queue;
+	timer->seq = timer_seq++;
+	pheap_insert (queue, &timer->elem);
+}
+
+/* Returns the timer on QUEUE with the earliest deadline, or a
+   null pointer if QUEUE is empty. */
+static struct timer *
+timer_first (struct pheap *queue) {
+	struct pheap_elem *e = pheap_min (queue);
+
+	return e != NULL ? pheap_entry (e, struct timer, elem) : NULL;
+}
+
+/* Arms TIMER to call FUNC with AUX from the timer interrupt once
+   timer_ticks() reaches DEADLINE.  A deadline that has already
+   passed fires on the next tick.  TIMER must be zeroed or not
+   pending.
+
+   This function may be called from an interrupt handler, in
+   particular from a timer callback that re-arms its own timer. */
+void
+timer_add (struct timer *timer, int64_t deadline, timer_func *func,
+		void *aux) {
+	enum intr_level old_level;
+
+	ASSERT (timer != NULL);
+	ASSERT (func != NULL);
+
+	old_level = intr_disable ();
+	timer_enqueue (&timer_queue, timer, deadline, func, aux);
+	intr_set_level (old_level);
+}
+
+/* Like timer_add(), but DEADLINE is in nanoseconds as returned
+   by timer_ns(), and FUNC is called within about 125 us of it
+   rather than on the next tick.  timer_cancel() disarms it. */
+void
+timer_add_ns (struct timer *timer, int64_t deadline, timer_func *func,
+		void *aux) {
+	enum intr_level old_level;
+
+	ASSERT (timer != NULL);
+	ASSERT (func != NULL);
+
+	old_level = intr_disable ();
+	if (pheap_empty (&hrtimer_queue))
+		rtc_set_periodic (true);
+	timer_enqueue (&hrtimer_queue, timer, deadline, func, aux);
+	intr_set_level (old_level);
+}
+
+/* Disarms TIMER.  Returns true if it was pending, false if it
+   had already fired or was never armed. */
+bool
+timer_cancel (struct timer *timer) {
+	enum intr_level old_level;
+	bool pending;
+
+	ASSERT (timer != NULL);
+
+	old_level = intr_disable ();
+	pending = timer->pending;
+	if (pending) {
+		pheap_remove (timer->queue, &timer->elem);
+		timer->pending = false;
+	}
+	intr_set_level (old_level);
+	return pending;
+}
+
 /* Suspends execution for approximately MS milliseconds. */
 void
 timer_msleep (int64_t ms) {
@@ -127,28 +434,173 @@ timer_nsleep (int64_t ns) {
 	real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, right before
+   it halts.  In tickless mode, switches the PIT to a single
+   interrupt at the earliest of the next timer deadline, the next
+   mlfqs recomputation and the longest period the PIT supports,
+   so an idle CPU is not woken on every tick. */
+void
+timer_tickless_enter (void) {
+	int64_t delta = PIT_MAX_ONESHOT_TICKS;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!timer_tickless || oneshot_ticks != 0)
+		return;
+
+	if (!pheap_empty (&timer_queue)) {
+		int64_t next = timer_first (&timer_queue)->deadline;
+		if (next - ticks < delta)
+			delta = next - ticks;
+	}
+	/* mlfqs must see every tick that is a multiple of 4. */
+	if (thread_mlfqs && 4 - ticks % 4 < delta)
+		delta = 4 - ticks % 4;
+	if (delta <= 1)
+		return;
+
+	oneshot_ticks = delta;
+	pit_program (0, delta * PIT_TICK_COUNT);
+}
+
+/* Called with interrupts off when the CPU stops idling.  If a
+   one-shot period is still in progress, that is, some other
+   interrupt woke the CPU early, credits the whole ticks that
+   elapsed so far and returns the PIT to periodic mode. */
+void
+timer_tickless_exit (void) {
+	int64_t elapsed;
+	uint16_t remaining;
+	uint8_t status;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (oneshot_ticks == 0)
+		return;
+
+	outb (0x43, 0x00);    /* CW: latch counter 0. */
+	remaining = inb (0x40);
+	remaining |= inb (0x40) << 8;
+	outb (0x43, 0xe2);    /* Read-back: status of counter 0. */
+	status = inb (0x40);
+
+	/* Once the counter expires, OUT goes high and the counter
+	   wraps around, so REMAINING means nothing.  The whole period
+	   has elapsed then: its interrupt is pending and accounts for
+	   the last tick itself, so credit the others here. */
+	if (status & 0x80)
+		elapsed = oneshot_ticks - 1;
+	else if (status & 0x40)         /* Count not loaded yet. */
+		elapsed = 0;
+	else {
+		elapsed = (oneshot_ticks * PIT_TICK_COUNT - remaining) / PIT_TICK_COUNT;
+		if (elapsed < 0)
+			elapsed = 0;
+		else if (elapsed > oneshot_ticks - 1)
+			elapsed = oneshot_ticks - 1;
+	}
+
+	oneshot_ticks = 0;
+	pit_program (2, PIT_TICK_COUNT);
+	ticks += elapsed;
+	thread_idle_ticks (elapsed);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+	if (tsc_hz != 0)
+		printf ("Timer: TSC %'"PRIu64" Hz, %lld hrtimers, "
+				"%lld RTC interrupts\n",
+				tsc_hz, hrtimer_cnt, rtc_interrupt_cnt);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
+	if (oneshot_ticks != 0) {
+		/* A one-shot period ran to completion while idle. */
+		ticks += oneshot_ticks - 1;
+		thread_idle_ticks (oneshot_ticks - 1);
+		oneshot_ticks = 0;
+		pit_program (2, PIT_TICK_COUNT);
+	}
 	ticks++;
 	thread_tick ();
 
-	struct list_elem *e=list_begin(&sleep_list);
-	while(e!=list_end(&sleep_list)){
-		struct list_elem *next=list_next(e);
-		struct thread *cur=list_entry(e,struct thread, elem);
-		if(cur->sleep_time <=ticks){
-			list_remove(e);
-			thread_unblock(cur);
-		}
-		e=next;
+	while (!pheap_empty (&timer_queue)) {
+		struct timer *timer = timer_first (&timer_queue);
+		if (timer->deadline > ticks)
+			break;
+		pheap_pop_min (&timer_queue);
+		timer->pending = false;
+		timer->func (timer, timer->aux);
 	}
+	hrtimer_run ();
+}
+
+/* RTC interrupt handler, taken only while high-resolution
+   timers are pending. */
+static void
+rtc_interrupt (struct intr_frame *args UNUSED) {
+	/* Reading register C acknowledges the interrupt. */
+	outb (RTC_INDEX, RTC_REG_C);
+	inb (RTC_DATA);
+	rtc_interrupt_cnt++;
+	hrtimer_run ();
+}
+
+/* Fires the high-resolution timers whose deadlines have passed,
+   and turns the RTC interrupt off once none are left. */
+static void
+hrtimer_run (void) {
+	int64_t now;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (pheap_empty (&hrtimer_queue))
+		return;
+	now = timer_ns ();
+	while (!pheap_empty (&hrtimer_queue)) {
+		struct timer *timer = timer_first (&hrtimer_queue);
+		if (timer->deadline > now)
+			break;
+		pheap_pop_min (&hrtimer_queue);
+		timer->pending = false;
+		hrtimer_cnt++;
+		timer->func (timer, timer->aux);
+	}
+	if (pheap_empty (&hrtimer_queue))
+		rtc_set_periodic (false);
+}
+
+/* Turns the RTC periodic interrupt on or off.  Interrupts must
+   be off, or the RTC not yet in use. */
+static void
+rtc_set_periodic (bool on) {
+	uint8_t b;
+
+	outb (RTC_INDEX, RTC_REG_B);
+	b = inb (RTC_DATA);
+	b = on ? b | RTC_B_PIE : b & ~RTC_B_PIE;
+	outb (RTC_INDEX, RTC_REG_B);
+	outb (RTC_DATA, b);
+
+	/* Clear any interrupt already latched, or the RTC will not
+	   raise another. */
+	outb (RTC_INDEX, RTC_REG_C);
+	inb (RTC_DATA);
+}
+
+/* Programs PIT counter 0 in MODE (0: interrupt on terminal count,
+   2: rate generator) with COUNT. */
+static void
+pit_program (uint8_t mode, uint16_t count) {
+	/* CW: counter 0, LSB then MSB, MODE, binary. */
+	outb (0x43, 0x30 | (mode << 1));
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -200,10 +652,11 @@ real_time_sleep (int64_t num, int32_t denom) {
 		   processes. */
 		timer_sleep (ticks);
 	} else {
-		/* Otherwise, use a busy-wait loop for more accurate
-		   sub-tick timing.  We scale the numerator and denominator
-		   down by 1000 to avoid the possibility of overflow. */
+		/* Otherwise, block on a high-resolution timer for more
+		   accurate sub-tick timing.  We scale the numerator and
+		   denominator down by 1000 to avoid the possibility of
+		   overflow. */
 		ASSERT (denom % 1000 == 0);
-		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+		hr_sleep (num * (NS_PER_SEC / 1000) / (denom / 1000));
 	}
 }
@@ -123,10 +123,12 @@ dir_lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	inode_read_lock (dir->inode);
 	if (lookup (dir, name, &e, NULL)){
 		*inode = inode_open (e.inode_sector);
 	}else
 		*inode = NULL;
+	inode_read_unlock (dir->inode);
 
 	return *inode != NULL;
 }
@@ -150,6 +152,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	inode_write_lock (dir->inode);
 	/* Check that NAME is not in use. */
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
@@ -174,6 +177,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	inode_write_unlock (dir->inode);
 	return success;
 }
 
@@ -191,6 +195,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	inode_write_lock (dir->inode);
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -226,6 +231,7 @@ dir_remove (struct dir *dir, const char *name) {
 	success = true;
 
 done:
+	inode_write_unlock (dir->inode);
 	inode_close (inode);
 	return success;
 }
@@ -236,17 +242,21 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	inode_read_lock (dir->inode);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			if(!strcmp(e.name, ".") || !strcmp(e.name, ".."))
 				continue;
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	inode_read_unlock (dir->inode);
+	return found;
 }
 
 /* caller must close inode */
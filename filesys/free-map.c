@@ -7,6 +7,7 @@
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t free_map_cursor;       /* Where the last allocation ended. */
 
 /* Initializes the free map. */
 void
@@ -24,7 +25,8 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	disk_sector_t sector = bitmap_scan_and_flip_next (free_map, &free_map_cursor,
+			cnt, false);
 	if (sector != BITMAP_ERROR
 			&& free_map_file != NULL
 			&& !bitmap_write (free_map, free_map_file)) {
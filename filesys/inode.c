@@ -10,7 +10,10 @@
 #include "filesys/free-map.h"
 #include "filesys/fat.h"
 #include "filesys/page_cache.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/workqueue.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -39,6 +42,9 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct rwlock rwlock;               /* Guards directory contents. */
+	struct work readahead;              /* Reads READAHEAD_CLST ahead. */
+	cluster_t readahead_clst;           /* Cluster to read ahead. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -71,18 +77,28 @@ byte_to_cluster (struct inode *inode, off_t pos, bool create) {
 }
 
 /* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
+ * returns the same `struct inode'.  Lookups only read the list,
+ * so they share OPEN_INODES_LOCK; insertion and removal take it
+ * exclusively. */
 static struct list open_inodes;
-extern struct list swapin_queue;
+static struct rwlock open_inodes_lock;
 extern struct lock cache_lock;
-extern struct condition not_empty;
-extern struct condition job_done;
 extern struct page *alloc_pages[8];
 
+/* Readahead work: brings the cluster after the last one read
+   into the page cache, so a sequential reader finds it there. */
+static void
+inode_readahead (struct work *w) {
+	struct inode *inode = work_entry (w, struct inode, readahead);
+
+	page_cache_fill (inode->readahead_clst);
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	rwlock_init (&open_inodes_lock);
 }
 
 void
@@ -134,25 +150,37 @@ inode_create (cluster_t cluster, off_t length, enum inode_type type) {
 }
 
 
+/* Returns the open inode for CLUSTER and takes a reference to
+ * it, or returns a null pointer if it is not open.
+ * OPEN_INODES_LOCK must be held in either mode. */
+static struct inode *
+find_open_inode (cluster_t cluster) {
+	struct list_elem *e;
+
+	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+			e = list_next (e)) {
+		struct inode *inode = list_entry (e, struct inode, elem);
+		if (inode->cluster == cluster)
+			return inode_reopen (inode);
+	}
+	return NULL;
+}
+
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (cluster_t cluster) {
-	struct list_elem *e;
-	struct inode *inode;
+	struct inode *inode, *found;
 //	printf("inode %d open\n",cluster);
 	disk_sector_t sector = cluster_to_sector(cluster);
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->cluster == cluster) {
-			inode_reopen (inode);
-			return inode; 
-		}
-	}
+	rwlock_acquire_read (&open_inodes_lock);
+	inode = find_open_inode (cluster);
+	rwlock_release_read (&open_inodes_lock);
+	if (inode != NULL)
+		return inode;
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
@@ -160,12 +188,24 @@ inode_open (cluster_t cluster) {
 		return NULL;
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->cluster = cluster;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
+	rwlock_init (&inode->rwlock);
+	work_init (&inode->readahead, inode_readahead);
 	disk_read (filesys_disk, sector, &inode->data);
+
+	/* Someone else may have opened it while we were reading. */
+	rwlock_acquire_write (&open_inodes_lock);
+	found = find_open_inode (cluster);
+	if (found == NULL)
+		list_push_front (&open_inodes, &inode->elem);
+	rwlock_release_write (&open_inodes_lock);
+	if (found != NULL) {
+		free (inode);
+		return found;
+	}
 	return inode;
 }
 
@@ -173,7 +213,10 @@ inode_open (cluster_t cluster) {
 struct inode *
 inode_reopen (struct inode *inode) {
 	if (inode != NULL){
+		/* Lookups under a shared lock may race here. */
+		enum intr_level old_level = intr_disable ();
 		inode->open_cnt++;
+		intr_set_level (old_level);
 	}
 	return inode;
 }
@@ -191,15 +234,25 @@ void
 inode_close (struct inode *inode) {
 	cluster_t cluster_idx;
 	struct page * page;
+	enum intr_level old_level;
+	bool last;
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
+	rwlock_acquire_write (&open_inodes_lock);
+	old_level = intr_disable ();
+	last = --inode->open_cnt == 0;
+	intr_set_level (old_level);
+	/* Remove from inode list and release lock. */
+	if (last)
 		list_remove (&inode->elem);
-		
+	rwlock_release_write (&open_inodes_lock);
+
+	/* Release resources if this was the last opener. */
+	if (last) {
+		cancel_work (&inode->readahead);
+		flush_work (&inode->readahead);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
@@ -249,7 +302,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	cluster_t nxt_idx;
 	char page_ofs;
 	struct page *page;
-	struct page_cache *nxt_pcache;
 	if(cluster_idx==EOChain)
 		return 0;
 	int sector_ofs = offset % DISK_SECTOR_SIZE;		//TODO:need to change if sectors_per_cluster!=1
@@ -299,13 +351,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	if(cluster_idx != EOChain){
 		nxt_idx = fat_get(cluster_idx);
 		if(nxt_idx != EOChain){
-			lock_acquire(&cache_lock);
-			nxt_pcache = (struct page_cache *)malloc(sizeof(struct page_cache));
-			nxt_pcache->cluster_idx = nxt_idx;
-			nxt_pcache->is_accessed = true;//using this, worker will free request pacekt
-			list_push_back(&swapin_queue,&nxt_pcache->elem);
-			cond_signal(&not_empty, &cache_lock);
-			lock_release(&cache_lock);
+			inode->readahead_clst = nxt_idx;
+			page_cache_queue_readahead(&inode->readahead);
 		}
 	}
 
@@ -457,3 +504,27 @@ enum inode_type
 inode_type(const struct inode *inode){
 	return inode->data.type;
 }
+
+/* Locks INODE's contents for reading.  Any number of threads may
+ * hold the read lock at once. */
+void
+inode_read_lock (struct inode *inode) {
+	rwlock_acquire_read (&inode->rwlock);
+}
+
+void
+inode_read_unlock (struct inode *inode) {
+	rwlock_release_read (&inode->rwlock);
+}
+
+/* Locks INODE's contents for writing, excluding all other
+ * readers and writers. */
+void
+inode_write_lock (struct inode *inode) {
+	rwlock_acquire_write (&inode->rwlock);
+}
+
+void
+inode_write_unlock (struct inode *inode) {
+	rwlock_release_write (&inode->rwlock);
+}
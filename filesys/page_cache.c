@@ -6,14 +6,14 @@
 #include "lib/kernel/bitmap.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
 #include "filesys/filesys.h"
 #include "filesys/fat.h"
 
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
-static void page_cache_kworkerd (void *aux);
-static void regular_writeback_worker (void *aux);
+static work_func writeback_work_fn;
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -23,15 +23,18 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
-tid_t writeback_worker;
 struct page alloc_pages[8];//pages  cache
 
-struct list swapin_queue;
 struct lock cache_lock;
-struct condition not_empty;
-struct condition job_done;
 
+/* Readahead and periodic writeback run on the page cache's own
+   workqueue, so they show up separately in its statistics. */
+#define PCACHE_WORKERS 2
+static struct workqueue pcache_wq;
+
+/* Periodic writeback, re-queued by itself every interval. */
+#define WRITEBACK_INTERVAL 3000
+static struct work writeback_work;
 
 
 /* The initializer of file vm */
@@ -44,16 +47,18 @@ page_cache_init (void) {
 		page_cache_initializer(&alloc_pages[i], VM_PAGE_CACHE,palloc_get_page(0));
 	}
 	
-	list_init(&swapin_queue);
 	lock_init(&cache_lock);
-	cond_init(&not_empty);
-	cond_init(&job_done);
-	
-	page_cache_workerd = thread_create("pcache_worker",PRI_DEFAULT,page_cache_kworkerd,NULL);
-	writeback_worker = thread_create("writeback_worker",PRI_DEFAULT, regular_writeback_worker,NULL);
+
+	workqueue_create(&pcache_wq, "pcache", PCACHE_WORKERS);
+	work_init(&writeback_work, writeback_work_fn);
+	queue_delayed_work(&pcache_wq, &writeback_work, WRITEBACK_INTERVAL);
 }
 void
 page_cache_close(void){
+	/* A run under way may re-queue itself while we wait for it. */
+	cancel_work(&writeback_work);
+	flush_work(&writeback_work);
+	cancel_work(&writeback_work);
 	for(int i=0;i<8;i++){
 		destroy(&alloc_pages[i]);
 	}
@@ -121,54 +126,38 @@ page_cache_destroy (struct page *page) {
 	bitmap_destroy(pcache->swap_status);
 }
 
-/* Worker thread for page cache */
-static void
-page_cache_kworkerd (void *aux UNUSED) {
-	struct list_elem *e;
+/* Hands readahead work W to the page cache's workqueue. */
+bool
+page_cache_queue_readahead (struct work *w) {
+	return queue_work(&pcache_wq, w);
+}
+
+/* Brings cluster CLST into the cache unless it is there already.
+   Called by readahead work. */
+void
+page_cache_fill (cluster_t clst) {
 	struct page *page;
-	struct page_cache *pcache;
-	int i=0;
-	while(1){	//infinite loop
-		lock_acquire(&cache_lock);
-		while(list_empty(&swapin_queue)){
-			cond_wait(&not_empty,&cache_lock);
-		}
-		//swapin page.
-		e = list_pop_front(&swapin_queue);
-		pcache = list_entry(e, struct page_cache,elem);
-		if(page_cache_find(pcache->cluster_idx)){
-			cond_signal(&job_done, &cache_lock);
-			lock_release(&cache_lock);
-			continue;
-		}
 
+	lock_acquire(&cache_lock);
+	if(page_cache_find(clst) == NULL){
 		page = pcache_evict_cache();
-
-		page->page_cache.cluster_idx = pcache->cluster_idx & (~0x7);
+		page->page_cache.cluster_idx = clst & (~0x7);
 		swap_in(page,page->va);
-	//	pcache->kva = (void *)((char *)page_cache_kpage+(i*PGSIZE));
-		if(pcache->is_accessed)
-			free(pcache);
-	//	i++;
-	//	if(i>=8) i=0;
-	//	cond_broadcast(&job_done,&cache_lock);
-		lock_release(&cache_lock);
 	}
+	lock_release(&cache_lock);
 }
+
+/* Writes back every dirty cached cluster, then re-queues itself. */
 static void
-regular_writeback_worker (void *aux UNUSED){
-	struct page *page;
-	int i=0;
-	while(1){
-		timer_sleep(3000);
-		lock_acquire(&cache_lock);
-		for(i=0;i<8;i++){
-			if(alloc_pages[i].page_cache.cluster_idx != EOChain){
-				swap_out(&alloc_pages[i]);
-			}
+writeback_work_fn (struct work *w){
+	lock_acquire(&cache_lock);
+	for(int i=0;i<8;i++){
+		if(alloc_pages[i].page_cache.cluster_idx != EOChain){
+			swap_out(&alloc_pages[i]);
 		}
-		lock_release(&cache_lock);
 	}
+	lock_release(&cache_lock);
+	queue_delayed_work(&pcache_wq, w, WRITEBACK_INTERVAL);
 }
 int i=0;
 struct page * pcache_evict_cache(void){
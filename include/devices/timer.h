@@ -1,23 +1,55 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <pheap.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+struct timer;
+
+/* Called when a timer expires.  Runs in the timer interrupt
+   handler, so it must not sleep. */
+typedef void timer_func (struct timer *, void *aux);
+
+/* A one-shot kernel timer.  The owner embeds it in its own
+   object, so arming a timer never allocates. */
+struct timer {
+	int64_t deadline;           /* Tick, or ns for timer_add_ns(). */
+	timer_func *func;           /* Expiry callback. */
+	void *aux;                  /* Passed to FUNC. */
+	bool pending;               /* On a timer queue? */
+	struct pheap *queue;        /* The queue it is on, if pending. */
+	uint64_t seq;               /* Arming order, to break ties. */
+	struct pheap_elem elem;     /* Timer queue element. */
+};
+
+/* Dynamic-tick idle mode, set by "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_ns (void);
 
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_add (struct timer *, int64_t deadline, timer_func *, void *aux);
+void timer_add_ns (struct timer *, int64_t deadline_ns, timer_func *,
+		void *aux);
+bool timer_cancel (struct timer *);
+
+void timer_tickless_enter (void);
+void timer_tickless_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
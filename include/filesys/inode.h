@@ -28,5 +28,9 @@ void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_removed(const struct inode *);
 enum inode_type inode_type(const struct inode *);
+void inode_read_lock (struct inode *);
+void inode_read_unlock (struct inode *);
+void inode_write_lock (struct inode *);
+void inode_write_unlock (struct inode *);
 
 #endif /* filesys/inode.h */
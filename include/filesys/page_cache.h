@@ -4,12 +4,12 @@
 #include "filesys/fat.h"
 
 struct page;
+struct work;
 enum vm_type;
 
 struct page_cache {
 	cluster_t cluster_idx;
 	bool is_accessed;
-	struct list_elem elem;
 	struct bitmap *swap_status;
 };
 
@@ -18,4 +18,6 @@ void page_cache_close(void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
 struct page * page_cache_find(cluster_t clst);
 struct page * pcache_evict_cache(void);
+bool page_cache_queue_readahead (struct work *w);
+void page_cache_fill (cluster_t clst);
 #endif
@@ -50,6 +50,18 @@ static __inline uint64_t rcr3(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr0(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr0,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr0(uint64_t val) {
+	__asm __volatile("movq %0, %%cr0" : : "r" (val));
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rrax(void) {
 	uint64_t val;
@@ -128,4 +140,29 @@ static __inline void write_msr(uint32_t ecx, uint64_t val) {
 			:: "c" (ecx), "d" (edx), "a" (eax) );
 }
 
+/* Reads the time-stamp counter. */
+__attribute__((always_inline))
+static __inline uint64_t rdtsc(void) {
+	uint32_t lo, hi;
+	__asm __volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+/* Executes CPUID for LEAF, storing EAX, EBX, ECX and EDX in REGS. */
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t regs[4]) {
+	__asm __volatile("cpuid"
+			: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+			: "a" (leaf), "c" (0));
+}
+
+/* Returns the index of the most significant set bit in VAL.
+   VAL must not be zero. */
+__attribute__((always_inline))
+static __inline uint64_t bsrq(uint64_t val) {
+	uint64_t idx;
+	__asm __volatile("bsrq %1,%0" : "=r" (idx) : "rm" (val) : "cc");
+	return idx;
+}
+
 #endif /* intrinsic.h */
@@ -0,0 +1,64 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+ *
+ * A heap-ordered multiway tree ordered by a caller-supplied
+ * comparison function.  Insertion and melding are O(1) and
+ * finding the minimum is O(1); removing the minimum, or any
+ * other element, is O(log n) amortized.
+ *
+ * Like lists and red-black trees, the heap does not use dynamic
+ * allocation.  Each structure that can be in a heap must embed
+ * a struct pheap_elem member, and pheap_entry converts a pointer
+ * to that member back to the enclosing structure.  See
+ * lib/kernel/list.h for a detailed explanation of the idiom.
+ *
+ * The heap is not stable: callers that need elements that
+ * compare equal to leave in insertion order must break ties
+ * themselves, for example with a sequence number. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pairing heap element. */
+struct pheap_elem {
+	struct pheap_elem *child;   /* Leftmost child. */
+	struct pheap_elem *next;    /* Next sibling. */
+	struct pheap_elem *prev;    /* Previous sibling, or parent if
+	                               leftmost, or null for the root. */
+};
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+ * the structure that PHEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)     \
+	((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child   \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+		const struct pheap_elem *b,
+		void *aux);
+
+/* Pairing heap. */
+struct pheap {
+	struct pheap_elem *root;    /* Minimum element, or null if empty. */
+	pheap_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+void pheap_insert (struct pheap *, struct pheap_elem *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_pop_min (struct pheap *);
+
+struct pheap_elem *pheap_min (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
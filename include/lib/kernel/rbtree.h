@@ -0,0 +1,65 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree ordered by a caller-supplied
+ * comparison function.  Insertion, removal and lookup of the
+ * minimum element are all O(log n); the leftmost element is
+ * additionally cached so that rb_first() is O(1).
+ *
+ * Like lists and hash tables, the tree does not use dynamic
+ * allocation.  Each structure that can be in a tree must embed
+ * a struct rb_elem member, and rb_entry converts a pointer to
+ * that member back to the enclosing structure.  See
+ * lib/kernel/list.h for a detailed explanation of the idiom.
+ *
+ * Elements that compare equal are kept in insertion order:
+ * a new element is placed after every element it is not less
+ * than. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null for the root. */
+	struct rb_elem *left;       /* Left child. */
+	struct rb_elem *right;      /* Right child. */
+	bool red;                   /* Node color. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+ * the structure that RB_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b,
+		void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+	struct rb_elem *root;       /* Root node, or null if empty. */
+	struct rb_elem *first;      /* Leftmost node, or null if empty. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+
+struct rb_elem *rb_first (const struct rbtree *);
+struct rb_elem *rb_next (const struct rb_elem *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -36,6 +36,15 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* User threads. */
+	SYS_THREAD_SPAWN,           /* Start a thread in this process. */
+	SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+	SYS_FUTEX_WAIT,             /* Sleep on a user address. */
+	SYS_FUTEX_WAKE,             /* Wake sleepers on a user address. */
+
+	/* Time. */
+	SYS_CLOCK_GETTIME,          /* Read a clock. */
 };
 
 #endif /* lib/syscall-nr.h */
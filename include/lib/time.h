@@ -0,0 +1,18 @@
+#ifndef __LIB_TIME_H
+#define __LIB_TIME_H
+
+#include <stdint.h>
+
+/* Clock identifier for clock_gettime(). */
+typedef int clockid_t;
+
+/* Time since boot, never adjusted, with nanosecond resolution. */
+#define CLOCK_MONOTONIC 1
+
+/* A time value in seconds and nanoseconds. */
+struct timespec {
+	int64_t tv_sec;             /* Seconds. */
+	long tv_nsec;               /* Nanoseconds, 0...999,999,999. */
+};
+
+#endif /* lib/time.h */
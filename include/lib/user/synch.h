@@ -0,0 +1,33 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutex for threads started with thread_spawn().  Uncontended
+   lock and unlock stay in user space; only waiting enters the
+   kernel, through futex_wait(). */
+struct mutex {
+	int state;              /* 0: free, 1: held, 2: held with waiters. */
+};
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable, used together with a mutex. */
+struct condvar {
+	int seq;                /* Bumped by every signal or broadcast. */
+};
+
+#define CONDVAR_INITIALIZER { 0 }
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+bool condvar_timedwait (struct condvar *, struct mutex *, long timeout_ms);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/synch.h */
@@ -4,11 +4,16 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <time.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
@@ -38,6 +43,15 @@ void close (int fd);
 
 int dup2(int oldfd, int newfd);
 
+/* User threads.  STACK is the top of the new thread's stack. */
+tid_t thread_spawn (void (*entry) (void *), void *arg, void *stack);
+int thread_join (tid_t);
+/* futex_wait() returns 0 when woken, -1 if *ADDR != EXPECTED and
+   -2 when TIMEOUT_MS (ignored if negative) runs out. */
+int futex_wait (int *addr, int expected, long timeout_ms);
+int futex_wake (int *addr, int n);
+int clock_gettime (clockid_t, struct timespec *);
+
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
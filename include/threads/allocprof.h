@@ -0,0 +1,29 @@
+#ifndef THREADS_ALLOCPROF_H
+#define THREADS_ALLOCPROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Allocators whose callers are profiled. */
+enum allocprof_kind {
+	ALLOCPROF_MALLOC,   /* malloc() and friends; class is block size. */
+	ALLOCPROF_PALLOC,   /* palloc_get_*(); class is page count. */
+	ALLOCPROF_KIND_CNT
+};
+
+/* Callsite tag for memory allocated while profiling was off or
+   after the site table filled up. */
+#define ALLOCPROF_UNTRACKED 0
+
+/* True if allocations are being profiled.
+   Enabled by kernel command-line option "-allocprof", and never
+   changed after the allocators start up. */
+extern bool allocprof_enabled;
+
+uint16_t allocprof_alloc (enum allocprof_kind, const void *caller,
+		size_t class, size_t bytes);
+void allocprof_free (uint16_t site, size_t bytes);
+void allocprof_dump (void);
+
+#endif /* threads/allocprof.h */
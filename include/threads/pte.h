@@ -41,5 +41,12 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MB page (PDEs only). */
+
+/* A PDE with PTE_PS set maps a whole 2 MB "large page" instead of
+   pointing to a page table.  Its physical address must be 2 MB
+   aligned. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)   /* Bytes in a large page. */
+#define LARGE_PGMASK (LARGE_PGSIZE - 1)  /* Offset bits in a large page. */
 
 #endif /* threads/pte.h */
@@ -0,0 +1,21 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Cache of fixed-size objects.  Opaque; see threads/slab.c. */
+struct kmem_cache;
+
+/* Constructor, run once on each object when its slab is
+   created.  Objects must be freed in their constructed state. */
+typedef void kmem_ctor_func (void *obj);
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+		kmem_ctor_func *ctor);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_reclaim (void);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
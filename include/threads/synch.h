@@ -2,12 +2,32 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <pheap.h>
 #include <stdbool.h>
+#include "threads/interrupt.h"
+
+struct thread;
+
+/* Priority wait queue: blocked threads, highest priority first
+   and FIFO among equal priorities.  Insertion is O(1), removal
+   O(log n) amortized.  A thread whose priority changes while it
+   waits is moved to its new place by thread_change_priority().
+   Interrupts must be off while a wait queue is used. */
+struct waitq {
+	struct pheap heap;          /* Waiting threads. */
+};
+
+void waitq_init (struct waitq *);
+bool waitq_empty (const struct waitq *);
+void waitq_push (struct waitq *, struct thread *);
+struct thread *waitq_front (const struct waitq *);
+struct thread *waitq_pop (struct waitq *);
+void waitq_requeue (struct thread *, int priority);
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -20,8 +40,7 @@ void sema_self_test (void);
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
-	struct list_elem elem;
-	int given_priority;
+	struct list_elem elem;      /* Element in holder's held_locks. */
 };
 
 void lock_init (struct lock *);
@@ -32,7 +51,7 @@ bool lock_held_by_current_thread (const struct lock *);
 
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads. */
 };
 
 void cond_init (struct condition *);
@@ -40,6 +59,32 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock {
+	struct lock lock;           /* Held by the writer for its whole section. */
+	unsigned readers;           /* # of threads holding the lock shared. */
+	bool writer_waiting;        /* Writer waiting for readers to drain? */
+	struct semaphore drained;   /* Upped when the last reader leaves. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
+/* Spinlock.  Guards short critical sections that other CPUs may
+   enter concurrently; it also disables interrupts on the local
+   CPU for as long as it is held.  Never sleep while holding one. */
+struct spinlock {
+	volatile unsigned locked;   /* Nonzero while held. */
+	enum intr_level old_level;  /* Interrupt level to restore. */
+};
+
+void spin_lock_init (struct spinlock *);
+void spin_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -3,6 +3,8 @@
 
 #include <debug.h>
 #include <list.h>
+#include <pheap.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
@@ -29,6 +31,9 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+struct cpu;
+struct process;
+
 struct child_pipe {			/* used for fork and wait. */
 	tid_t tid;
 	int exit_status;		/* when process exit, it sets exit status and perform sema_up */
@@ -118,36 +123,37 @@ struct thread {
 
 	struct list_elem *parent_pipe;		//used for sending exit status and give signal to parent.
 	struct list child_list;			//list of child. contains address to child thread
-	struct list fd_list;			//list of fds. not yet implemented.
-	int num_fd;
-	struct file *exec_file;
+	struct process *proc;			//address space and fds, shared by its threads
 	/* for USERPROG management  */
 
-	
-	int sleep_time;
 
 	//for priority scheduler
-	int orig_priority;
-	struct list donation_list;
-	struct lock *waiting_lock;
+	int base_priority;		//priority before donation
+	struct list held_locks;		//locks we hold, for donation
+	struct lock *waiting_lock;	//lock we are waiting for
+	struct waitq *waitq;		//wait queue we are blocked on
+	struct pheap_elem wait_elem;	//element in waitq
+	uint64_t wait_seq;		//orders equal priorities in waitq
 
 	int recent_cpu;
 	int nice;
+	int64_t cpu_epoch;		//# of recent_cpu decays applied (mlfqs)
 	struct list_elem ent_e;
+	int64_t vruntime;		//weighted run time (cfs)
 	
 	//used for filesystem
 	struct dir *cur_dir;
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
+	struct cpu *cpu;                    /* CPU whose run queue holds us. */
+	struct rb_elem rq_elem;             /* Run queue element (cfs). */
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
 #endif
 #ifdef VM
-	/* Table for whole virtual memory owned by thread. */
-	struct supplemental_page_table spt;
 	/* rsp saved on initial transition from user to kernel mode. */
 	uintptr_t trsp;
 #endif
@@ -162,10 +168,20 @@ struct thread {
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler, which runs the
+   ready thread with the least weighted run time.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* Most pages of dead threads kept for reuse.
+   Controlled by kernel command-line option "-tcache=COUNT". */
+extern size_t thread_cache_max;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_ticks (int64_t);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -183,6 +199,8 @@ void thread_yield (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
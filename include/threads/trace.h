@@ -0,0 +1,33 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+
+/* Scheduler events recorded in the trace buffer. */
+enum trace_type {
+	TRACE_SWITCH,       /* Switched from TID to thread ARG. */
+	TRACE_BLOCK,        /* TID blocked. */
+	TRACE_UNBLOCK,      /* TID made ready, with priority ARG. */
+	TRACE_DONATE,       /* TID received donated priority ARG. */
+	TRACE_SLEEP,        /* TID went to sleep for ARG ticks. */
+	TRACE_WAKE,         /* TID woke up from sleep. */
+	TRACE_TYPE_CNT
+};
+
+/* True while events are being recorded.
+   Enabled by kernel command-line option "-trace". */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_type, int tid, int arg);
+void trace_dump (void);
+
+/* Records an event if tracing is on.  Cheap enough to leave in
+   the scheduler's hot paths. */
+#define TRACE(TYPE, TID, ARG)                           \
+	do {                                                \
+		if (trace_enabled)                              \
+			trace_record ((TYPE), (TID), (ARG));        \
+	} while (0)
+
+#endif /* threads/trace.h */
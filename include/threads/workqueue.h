@@ -0,0 +1,70 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+struct work;
+struct workqueue;
+
+/* Performs deferred work W.  Runs in a worker thread, so it may
+   sleep. */
+typedef void work_func (struct work *w);
+
+/* A unit of deferred work.  The owner embeds it in its own
+   object and recovers that object in FUNC with work_entry(), so
+   queueing work never allocates.  A work item is on at most one
+   queue at a time. */
+struct work {
+	work_func *func;            /* What to do. */
+	struct workqueue *wq;       /* Queue it was last handed to. */
+	bool pending;               /* Queued or waiting on its timer? */
+	unsigned running;           /* # of workers running it now. */
+	int64_t queued;             /* Tick at which it was queued. */
+	struct timer timer;         /* Delay for queue_delayed_work(). */
+	struct list_elem elem;      /* Element in queue's pending list. */
+};
+
+/* Converts pointer to work item WORK into a pointer to the
+   structure that WORK is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   work item. */
+#define work_entry(WORK, STRUCT, MEMBER)            \
+	((STRUCT *) ((uint8_t *) (WORK)                 \
+		- offsetof (STRUCT, MEMBER)))
+
+/* A queue of work served by a pool of worker threads. */
+struct workqueue {
+	const char *name;           /* Name, for statistics. */
+	struct list pending;        /* Work ready to run. */
+	struct semaphore avail;     /* Counts the entries in PENDING. */
+	struct waitq flushers;      /* Threads waiting in flush_work(). */
+	struct list_elem elem;      /* Element in list of all queues. */
+
+	/* Statistics. */
+	long long queued_cnt;       /* # of work items queued. */
+	long long delayed_cnt;      /* # of those queued with a delay. */
+	long long run_cnt;          /* # of work items run. */
+	long long wait_ticks;       /* Total ticks spent queued. */
+	size_t depth;               /* Current length of PENDING. */
+	size_t max_depth;           /* Greatest length of PENDING. */
+};
+
+/* Shared queue for work that needs no queue of its own. */
+extern struct workqueue system_wq;
+
+void workqueue_init (void);
+void workqueue_create (struct workqueue *, const char *name, int workers);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *);
+bool queue_work (struct workqueue *, struct work *);
+bool queue_delayed_work (struct workqueue *, struct work *, int64_t ticks);
+bool cancel_work (struct work *);
+void flush_work (struct work *);
+
+#endif /* threads/workqueue.h */
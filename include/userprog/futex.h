@@ -0,0 +1,15 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+/* futex_wait() results. */
+#define FUTEX_WOKEN 0           /* Woken by futex_wake(). */
+#define FUTEX_CHANGED (-1)      /* *UADDR did not hold the expected value. */
+#define FUTEX_TIMEDOUT (-2)     /* Timeout expired first. */
+
+void futex_init (void);
+int futex_wait (int *uaddr, int expected, int64_t timeout_ms);
+int futex_wake (int *uaddr, int n);
+
+#endif /* userprog/futex.h */
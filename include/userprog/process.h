@@ -3,13 +3,38 @@
 
 #include "threads/thread.h"
 
+/* State shared by all threads of a user process: the address
+   space's supplemental page table and the file descriptor table.
+   Threads created by process_spawn() share their creator's
+   process, and each caches the process's pml4 in its own `pml4'
+   member.  The last thread to exit tears the process down.
+   Interrupts must be off to change REFCNT, FD_LIST or THREADS. */
+struct process {
+	int refcnt;                     /* # of threads in the process. */
+#ifdef VM
+	struct supplemental_page_table spt;
+#endif
+	struct list fd_list;            /* Open files, as struct fd_cont. */
+	int num_fd;                     /* Next file descriptor to hand out. */
+	struct file *exec_file;         /* Executable, denied writes. */
+	struct list_elem *parent_pipe;  /* Reports exit status to parent. */
+	struct list threads;            /* Joinable threads, as child_pipe. */
+};
 
+
+void process_cache_init (void);
+struct fd_cont *fd_cont_alloc (void);
+void fd_cont_free (struct fd_cont *);
+struct fd_list *fd_list_alloc (void);
+void fd_list_free (struct fd_list *);
 struct child_pipe *get_pipe_by_tid(struct thread *t, tid_t tid);
 struct fd_cont * get_cont_by_fd(struct thread *t, int fd);
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
 int process_wait (tid_t);
+tid_t process_spawn (uintptr_t entry, uintptr_t arg, uintptr_t stack);
+int process_join (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
 
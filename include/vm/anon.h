@@ -11,5 +11,8 @@ struct anon_page {
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share_swap (struct page *dst, const struct page *src);
+void anon_swap_out_many (struct page *pages[], size_t cnt);
+void anon_print_stats (void);
 
 #endif
@@ -51,6 +51,7 @@ struct page {
 	struct lock pglock;
 	struct hash_elem elem;
 	struct list_elem list_elem;	//only used for page_cache
+	struct list_elem frame_elem;	//element of frame->pages
 	uint64_t *pml4;
 	bool writable;
 	enum vm_type type;
@@ -66,12 +67,25 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one for each frame of the user pool, in ft.frames, so
+ * the frame holding a kernel virtual address is found by
+ * indexing.  After fork() several anonymous pages may share one
+ * frame copy-on-write; PAGES lists them all, and PAGE is the one
+ * that swap-out goes through.  All fields but KVA are guarded by
+ * ft_lock.  The structure fills exactly one cache line. */
 struct frame {
 	void *kva;
 	struct page *page;
-	struct list_elem elem;
-};
+	struct list pages;	/* Pages mapping this frame. */
+	unsigned ref_cnt;	/* Number of elements in PAGES. */
+	uint16_t pin_cnt;	/* Never evicted while nonzero. */
+	uint16_t flags;		/* FRAME_* bits. */
+} __attribute__ ((aligned (64)));
+
+/* Frame flags. */
+#define FRAME_USED 0x1		/* Allocated to the VM. */
+#define FRAME_EVICTING 0x2	/* Being swapped out. */
 
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
@@ -95,9 +109,12 @@ struct page_operations {
 struct supplemental_page_table {
 	struct hash spt_hash;	
 };
-struct frame_table{
-	struct list ft_hash;
-	struct list_elem *hand;
+struct frame_table {
+	struct frame *frames;	/* One for each frame of the user pool. */
+	size_t cnt;		/* Number of frames. */
+	uint8_t *base;		/* Kernel virtual address of frames[0]. */
+	size_t hand;		/* Back hand of the clock, which evicts. */
+	size_t spread;		/* How far the front hand runs ahead. */
 };
 
 #include "threads/thread.h"
@@ -120,6 +137,7 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void vm_release_frame (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
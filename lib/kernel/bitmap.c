@@ -194,33 +194,101 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Returns a mask of the bits in an element from bit FIRST up to,
+   but not including, bit FIRST + CNT, both taken modulo
+   ELEM_BITS.  FIRST + CNT may equal ELEM_BITS. */
+static inline elem_type
+range_mask (size_t first, size_t cnt) {
+	elem_type high = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1
+		: (elem_type) -1;
+	return high << first;
+}
+
+/* Returns the number of 1-bits in WORD.  The kernel is not
+   linked with libgcc, which __builtin_popcountl() would call. */
+static inline size_t
+popcount (elem_type word) {
+	word -= (word >> 1) & 0x5555555555555555UL;
+	word = (word & 0x3333333333333333UL) + ((word >> 2) & 0x3333333333333333UL);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (word * 0x0101010101010101UL) >> 56;
+}
+
+/* Returns element IDX of B with every bit that equals VALUE set
+   to 1 and every other bit set to 0. */
+static inline elem_type
+elem_matching (const struct bitmap *b, size_t idx, bool value) {
+	return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Looks at whole elements at a time. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value) {
+	size_t idx = elem_idx (start);
+	elem_type word;
+
+	if (start >= end)
+		return end;
+	word = elem_matching (b, idx, value) & ~(bit_mask (start) - 1);
+	while (word == 0) {
+		if (++idx >= elem_cnt (end))
+			return end;
+		word = elem_matching (b, idx, value);
+	}
+	start = idx * ELEM_BITS + __builtin_ctzl (word);
+	return start < end ? start : end;
+}
+
+/* Atomically sets the bits in MASK of element IDX of B to
+   VALUE. */
+static inline void
+set_elem_bits (struct bitmap *b, size_t idx, elem_type mask, bool value) {
+	if (value)
+		asm ("lock orq %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+	else
+		asm ("lock andq %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
+}
+
+/* Sets the CNT bits starting at START in B to VALUE, a whole
+   element at a time.  Each element is updated atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (cnt > 0) {
+		size_t ofs = start % ELEM_BITS;
+		size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+
+		set_elem_bits (b, elem_idx (start), range_mask (ofs, n), value);
+		start += n;
+		cnt -= n;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t value_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
 	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
+	while (cnt > 0) {
+		size_t ofs = start % ELEM_BITS;
+		size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+		elem_type word = elem_matching (b, elem_idx (start), value);
+
+		value_cnt += popcount (word & range_mask (ofs, n));
+		start += n;
+		cnt -= n;
+	}
 	return value_cnt;
 }
 
@@ -228,16 +296,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -260,24 +323,38 @@ bool
 bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 	return !bitmap_contains (b, start, cnt, false);
 }
-
+
 /* Finding set or unset bits. */
 
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Skips from each candidate to the first bit that is not VALUE
+   after it, so each element is examined a bounded number of
+   times. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
+	if (cnt == 0)
+		return start;
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
+		size_t i = start;
+
+		while (i <= last) {
+			size_t end;
+
+			i = find_next (b, i, last + 1, value);
+			if (i > last)
+				break;
+			end = find_next (b, i, i + cnt, !value);
+			if (end == i + cnt)
 				return i;
+			i = end + 1;
+		}
 	}
 	return BITMAP_ERROR;
 }
@@ -296,7 +373,30 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
 		bitmap_set_multiple (b, idx, cnt, !value);
 	return idx;
 }
-
+
+/* Like bitmap_scan_and_flip(), but next-fit: starts at *CURSOR
+   rather than at the beginning, wrapping around to the beginning
+   if need be, and on success moves *CURSOR just past the group
+   that was flipped.  This spreads allocations across B and keeps
+   each scan from walking over the groups taken by earlier
+   ones. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+		bool value) {
+	size_t idx;
+
+	ASSERT (cursor != NULL);
+
+	if (*cursor > b->bit_cnt)
+		*cursor = 0;
+	idx = bitmap_scan_and_flip (b, *cursor, cnt, value);
+	if (idx == BITMAP_ERROR && *cursor != 0)
+		idx = bitmap_scan_and_flip (b, 0, cnt, value);
+	if (idx != BITMAP_ERROR)
+		*cursor = idx + cnt;
+	return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -0,0 +1,146 @@
+#include "pheap.h"
+#include "../debug.h"
+
+/* Pairing heap, following Fredman, Sedgewick, Sleator and
+   Tarjan, "The pairing heap: a new form of self-adjusting heap",
+   with the two-pass pairing used when a node's children are
+   merged back together.  Each node keeps a back pointer so that
+   an arbitrary node can be cut out of the tree, which is what
+   lets waiters change places when their key changes. */
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+pheap_init (struct pheap *heap, pheap_less_func *less, void *aux) {
+	ASSERT (heap != NULL);
+	ASSERT (less != NULL);
+
+	heap->root = NULL;
+	heap->less = less;
+	heap->aux = aux;
+}
+
+/* Links the trees rooted at A and B, neither of which may have
+   siblings, and returns the root of the result.  On a tie A
+   stays the root. */
+static struct pheap_elem *
+meld (struct pheap *heap, struct pheap_elem *a, struct pheap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (heap->less (b, a, heap->aux)) {
+		struct pheap_elem *t = a;
+		a = b;
+		b = t;
+	}
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single tree
+   and returns its root, or null if FIRST is null.  The first
+   pass melds the siblings in pairs from left to right, the
+   second melds the pairs together from right to left. */
+static struct pheap_elem *
+merge_pairs (struct pheap *heap, struct pheap_elem *first) {
+	struct pheap_elem *pairs = NULL;
+	struct pheap_elem *root = NULL;
+
+	/* First pass; PAIRS is a stack linked through `next', so it
+	   comes out in right-to-left order. */
+	while (first != NULL) {
+		struct pheap_elem *a = first;
+		struct pheap_elem *b = a->next;
+		struct pheap_elem *pair;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL)
+			b->next = b->prev = NULL;
+		pair = meld (heap, a, b);
+		pair->next = pairs;
+		pairs = pair;
+	}
+
+	/* Second pass. */
+	while (pairs != NULL) {
+		struct pheap_elem *pair = pairs;
+		pairs = pair->next;
+		pair->next = NULL;
+		root = meld (heap, root, pair);
+	}
+	return root;
+}
+
+/* Makes ROOT, which may be null, the root of HEAP. */
+static void
+set_root (struct pheap *heap, struct pheap_elem *root) {
+	if (root != NULL)
+		root->next = root->prev = NULL;
+	heap->root = root;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+pheap_insert (struct pheap *heap, struct pheap_elem *elem) {
+	ASSERT (heap != NULL);
+	ASSERT (elem != NULL);
+
+	elem->child = elem->next = elem->prev = NULL;
+	set_root (heap, meld (heap, heap->root, elem));
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+pheap_remove (struct pheap *heap, struct pheap_elem *elem) {
+	struct pheap_elem *sub;
+
+	ASSERT (heap != NULL);
+	ASSERT (elem != NULL);
+
+	sub = merge_pairs (heap, elem->child);
+	if (elem == heap->root) {
+		set_root (heap, sub);
+		return;
+	}
+
+	/* Cut ELEM's subtree out of its parent's child list, then
+	   put ELEM's children back as one tree. */
+	ASSERT (elem->prev != NULL);
+	if (elem->prev->child == elem)
+		elem->prev->child = elem->next;
+	else
+		elem->prev->next = elem->next;
+	if (elem->next != NULL)
+		elem->next->prev = elem->prev;
+	set_root (heap, meld (heap, heap->root, sub));
+}
+
+/* Removes and returns the minimum element of HEAP, or returns a
+   null pointer if HEAP is empty. */
+struct pheap_elem *
+pheap_pop_min (struct pheap *heap) {
+	struct pheap_elem *min = heap->root;
+
+	if (min != NULL)
+		pheap_remove (heap, min);
+	return min;
+}
+
+/* Returns the minimum element of HEAP, or a null pointer if HEAP
+   is empty. */
+struct pheap_elem *
+pheap_min (const struct pheap *heap) {
+	return heap->root;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+pheap_empty (const struct pheap *heap) {
+	return heap->root == NULL;
+}
@@ -0,0 +1,286 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following the presentation in Cormen et al.,
+   "Introduction to Algorithms", except that leaves are null
+   pointers rather than a shared sentinel node.  Null leaves are
+   black.  Because a null leaf has no parent pointer, the removal
+   fixup tracks the parent of the node being fixed up
+   separately. */
+
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Makes NEW take the place of OLD as a child of PARENT, or as
+   the root of TREE if PARENT is null. */
+static void
+replace_child (struct rbtree *tree, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new) {
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates the subtree rooted at X to the left.  X's right child
+   takes X's place. */
+static void
+rotate_left (struct rbtree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	replace_child (tree, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right.  X's left child
+   takes X's place. */
+static void
+rotate_right (struct rbtree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	replace_child (tree, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS given
+   auxiliary data AUX. */
+void
+rb_init (struct rbtree *tree, rb_less_func *less, void *aux) {
+	ASSERT (tree != NULL);
+	ASSERT (less != NULL);
+
+	tree->root = NULL;
+	tree->first = NULL;
+	tree->less = less;
+	tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE.  ELEM is placed after any elements
+   that compare equal to it. */
+void
+rb_insert (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem **link = &tree->root;
+	struct rb_elem *parent = NULL;
+	bool leftmost = true;
+
+	ASSERT (tree != NULL);
+	ASSERT (elem != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (tree->less (elem, parent, tree->aux))
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+	elem->parent = parent;
+	elem->left = elem->right = NULL;
+	elem->red = true;
+	*link = elem;
+	if (leftmost)
+		tree->first = elem;
+
+	/* Restore the red-black properties. */
+	while (is_red (elem->parent)) {
+		struct rb_elem *p = elem->parent;
+		struct rb_elem *g = p->parent;
+
+		if (p == g->left) {
+			struct rb_elem *u = g->right;
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				elem = g;
+			} else {
+				if (elem == p->right) {
+					rotate_left (tree, p);
+					elem = p;
+					p = elem->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_right (tree, g);
+			}
+		} else {
+			struct rb_elem *u = g->left;
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				elem = g;
+			} else {
+				if (elem == p->left) {
+					rotate_right (tree, p);
+					elem = p;
+					p = elem->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_left (tree, g);
+			}
+		}
+	}
+	tree->root->red = false;
+}
+
+/* Replaces the subtree rooted at U by the subtree rooted at V,
+   which may be null. */
+static void
+transplant (struct rbtree *tree, struct rb_elem *u, struct rb_elem *v) {
+	replace_child (tree, u->parent, u, v);
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+/* Restores the red-black properties after a black node was
+   removed from above X, whose parent is PARENT.  X may be a
+   null leaf. */
+static void
+remove_fixup (struct rbtree *tree, struct rb_elem *x,
+		struct rb_elem *parent) {
+	while (x != tree->root && !is_red (x)) {
+		if (x == parent->left) {
+			struct rb_elem *w = parent->right;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (tree, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (tree, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (tree, parent);
+				x = tree->root;
+			}
+		} else {
+			struct rb_elem *w = parent->left;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (tree, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (tree, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (tree, parent);
+				x = tree->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
+
+/* Removes ELEM from TREE.  ELEM must be in TREE. */
+void
+rb_remove (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem *x, *parent;
+	bool removed_red;
+
+	ASSERT (tree != NULL);
+	ASSERT (elem != NULL);
+
+	if (tree->first == elem)
+		tree->first = rb_next (elem);
+
+	if (elem->left == NULL || elem->right == NULL) {
+		x = elem->left != NULL ? elem->left : elem->right;
+		parent = elem->parent;
+		removed_red = elem->red;
+		transplant (tree, elem, x);
+	} else {
+		/* Splice out ELEM's successor Y and put it in ELEM's
+		   place. */
+		struct rb_elem *y = elem->right;
+		while (y->left != NULL)
+			y = y->left;
+		removed_red = y->red;
+		x = y->right;
+		if (y->parent == elem)
+			parent = y;
+		else {
+			parent = y->parent;
+			transplant (tree, y, y->right);
+			y->right = elem->right;
+			y->right->parent = y;
+		}
+		transplant (tree, elem, y);
+		y->left = elem->left;
+		y->left->parent = y;
+		y->red = elem->red;
+	}
+
+	if (!removed_red)
+		remove_fixup (tree, x, parent);
+}
+
+/* Returns the smallest element in TREE, or a null pointer if
+   TREE is empty. */
+struct rb_elem *
+rb_first (const struct rbtree *tree) {
+	ASSERT (tree != NULL);
+	return tree->first;
+}
+
+/* Returns the element that follows ELEM in its tree, or a null
+   pointer if ELEM is the largest. */
+struct rb_elem *
+rb_next (const struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->right != NULL) {
+		elem = elem->right;
+		while (elem->left != NULL)
+			elem = elem->left;
+		return (struct rb_elem *) elem;
+	}
+	while (elem->parent != NULL && elem == elem->parent->right)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rbtree *tree) {
+	ASSERT (tree != NULL);
+	return tree->root == NULL;
+}
@@ -0,0 +1,87 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* The mutex follows the three-state scheme from Drepper's
+   "Futexes Are Tricky": STATE is 0 when free, 1 when held and 2
+   when held with possible waiters, so that unlock only makes a
+   system call when someone may be sleeping. */
+
+void
+mutex_init (struct mutex *m) {
+	m->state = 0;
+}
+
+void
+mutex_lock (struct mutex *m) {
+	int c = __sync_val_compare_and_swap (&m->state, 0, 1);
+	if (c == 0)
+		return;
+
+	/* Contended: mark the mutex as having waiters and sleep until
+	   we are the one to take it from free. */
+	if (c != 2)
+		c = __atomic_exchange_n (&m->state, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		futex_wait (&m->state, 2, -1);
+		c = __atomic_exchange_n (&m->state, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+bool
+mutex_trylock (struct mutex *m) {
+	return __sync_bool_compare_and_swap (&m->state, 0, 1);
+}
+
+void
+mutex_unlock (struct mutex *m) {
+	if (__atomic_fetch_sub (&m->state, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n (&m->state, 0, __ATOMIC_RELEASE);
+		futex_wake (&m->state, 1);
+	}
+}
+
+/* A condition variable is a sequence number.  A waiter samples
+   it before dropping the mutex and sleeps only while it is
+   unchanged, so a signal sent between the unlock and the sleep
+   is not lost. */
+
+void
+condvar_init (struct condvar *cv) {
+	cv->seq = 0;
+}
+
+void
+condvar_wait (struct condvar *cv, struct mutex *m) {
+	condvar_timedwait (cv, m, -1);
+}
+
+/* Like condvar_wait(), but gives up after TIMEOUT_MS
+   milliseconds if TIMEOUT_MS is not negative.  Returns false on
+   timeout.  Either way M is held again on return. */
+bool
+condvar_timedwait (struct condvar *cv, struct mutex *m, long timeout_ms) {
+	int seq = __atomic_load_n (&cv->seq, __ATOMIC_RELAXED);
+	int result;
+
+	mutex_unlock (m);
+	result = futex_wait (&cv->seq, seq, timeout_ms);
+
+	/* Waiters may be several; taking the mutex as contended keeps
+	   the next unlock waking them in turn. */
+	while (__atomic_exchange_n (&m->state, 2, __ATOMIC_ACQUIRE) != 0)
+		futex_wait (&m->state, 2, -1);
+	return result != -2;
+}
+
+void
+condvar_signal (struct condvar *cv) {
+	__atomic_fetch_add (&cv->seq, 1, __ATOMIC_RELEASE);
+	futex_wake (&cv->seq, 1);
+}
+
+void
+condvar_broadcast (struct condvar *cv) {
+	__atomic_fetch_add (&cv->seq, 1, __ATOMIC_RELEASE);
+	futex_wake (&cv->seq, INT_MAX);
+}
@@ -145,6 +145,42 @@ dup2 (int oldfd, int newfd){
 	return syscall2 (SYS_DUP2, oldfd, newfd);
 }
 
+/* Where a thread started by thread_spawn() goes when its
+   function returns. */
+static void
+thread_return (void) {
+	exit (0);
+}
+
+tid_t
+thread_spawn (void (*entry) (void *), void *arg, void *stack) {
+	/* Leave a return address on the new stack, aligned as if
+	   ENTRY had been called. */
+	uintptr_t *sp = (uintptr_t *) ((uintptr_t) stack & ~(uintptr_t) 15) - 1;
+	*sp = (uintptr_t) thread_return;
+	return (tid_t) syscall3 (SYS_THREAD_SPAWN, entry, arg, sp);
+}
+
+int
+thread_join (tid_t tid) {
+	return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+int
+futex_wait (int *addr, int expected, long timeout_ms) {
+	return syscall3 (SYS_FUTEX_WAIT, addr, expected, timeout_ms);
+}
+
+int
+futex_wake (int *addr, int n) {
+	return syscall2 (SYS_FUTEX_WAKE, addr, n);
+}
+
+int
+clock_gettime (clockid_t clock, struct timespec *ts) {
+	return syscall2 (SYS_CLOCK_GETTIME, clock, ts);
+}
+
 void *
 mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	return (void *) syscall5 (SYS_MMAP, addr, length, writable, fd, offset);
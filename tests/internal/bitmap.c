@@ -0,0 +1,141 @@
+/* Test and micro-benchmark for scanning in lib/kernel/bitmap.c.
+
+   Checks bitmap_scan(), bitmap_count() and the next-fit
+   bitmap_scan_and_flip_next() against simple bit-at-a-time
+   versions on a 1M-bit map, and prints how long each takes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Number of bits in the maps we test. */
+#define BIT_CNT (1024 * 1024)
+
+/* Number of scans timed per run. */
+#define SCAN_CNT 64
+
+static size_t slow_scan (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static size_t slow_count (const struct bitmap *, bool value);
+static void fill (struct bitmap *, int percent);
+
+/* Tests and times bitmap scanning. */
+void
+test (void) 
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  int percent;
+
+  ASSERT (b != NULL);
+  for (percent = 50; percent <= 100; percent += 25) 
+    {
+      int64_t start, slow_ns, fast_ns;
+      size_t cursor, idx;
+      int i;
+
+      fill (b, percent);
+      printf ("%d%% set:\n", percent);
+
+      /* Scans for a run of 8 clear bits, starting at evenly
+         spaced points. */
+      start = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        slow_scan (b, (size_t) i * (BIT_CNT / SCAN_CNT), 8, false);
+      slow_ns = timer_ns () - start;
+
+      start = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        bitmap_scan (b, (size_t) i * (BIT_CNT / SCAN_CNT), 8, false);
+      fast_ns = timer_ns () - start;
+
+      for (i = 0; i < SCAN_CNT; i++) 
+        {
+          size_t ofs = (size_t) i * (BIT_CNT / SCAN_CNT);
+          ASSERT (bitmap_scan (b, ofs, 8, false) == slow_scan (b, ofs, 8, false));
+        }
+      printf ("  scan:  %lld ns bit at a time, %lld ns word at a time\n",
+              slow_ns, fast_ns);
+
+      /* Counts the set bits. */
+      start = timer_ns ();
+      idx = slow_count (b, true);
+      slow_ns = timer_ns () - start;
+      start = timer_ns ();
+      ASSERT (bitmap_count (b, 0, BIT_CNT, true) == idx);
+      fast_ns = timer_ns () - start;
+      printf ("  count: %lld ns bit at a time, %lld ns word at a time\n",
+              slow_ns, fast_ns);
+
+      /* Allocates single bits first-fit, then next-fit, from the
+         same starting state. */
+      fill (b, percent);
+      start = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        bitmap_scan_and_flip (b, 0, 1, false);
+      slow_ns = timer_ns () - start;
+
+      fill (b, percent);
+      cursor = 0;
+      start = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        bitmap_scan_and_flip_next (b, &cursor, 1, false);
+      fast_ns = timer_ns () - start;
+      printf ("  alloc: %lld ns first-fit, %lld ns next-fit\n",
+              slow_ns, fast_ns);
+    }
+  bitmap_destroy (b);
+}
+
+/* Sets about PERCENT percent of the bits in B, at random, and
+   the rest to false.  At 100 percent, every bit but the last
+   eight is set, so scans must cross the whole map. */
+static void
+fill (struct bitmap *b, int percent) 
+{
+  size_t i;
+
+  random_init (0);
+  for (i = 0; i < BIT_CNT; i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < percent);
+  if (percent == 100)
+    bitmap_set_multiple (b, BIT_CNT - 8, 8, false);
+}
+
+/* Returns the first run of CNT bits set to VALUE in B at or after
+   START, testing one bit at a time, as bitmap_scan() once did. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++) 
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns the number of bits in B set to VALUE, testing one bit
+   at a time. */
+static size_t
+slow_count (const struct bitmap *b, bool value) 
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    if (bitmap_test (b, i) == value)
+      cnt++;
+  return cnt;
+}
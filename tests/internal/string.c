@@ -0,0 +1,180 @@
+/* Micro-benchmark for the block functions in lib/string.c and
+   the page helpers in threads/palloc.c.
+
+   Checks memcpy(), memset() and memcmp() against byte-at-a-time
+   versions, at several sizes and alignments, and prints the
+   bytes per cycle each achieves.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Number of times each operation is repeated. */
+#define REPEAT 256
+
+static void byte_copy (uint8_t *, const uint8_t *, size_t);
+static void byte_set (uint8_t *, int, size_t);
+static int byte_cmp (const uint8_t *, const uint8_t *, size_t);
+static void report (const char *, size_t size, uint64_t before,
+                    uint64_t after);
+
+/* Tests and times the block functions. */
+void
+test (void) 
+{
+  static const size_t sizes[] = { 64, 512, PGSIZE };
+  uint8_t *src = palloc_get_multiple (PAL_ASSERT, 2);
+  uint8_t *dst = palloc_get_multiple (PAL_ASSERT, 2);
+  size_t i, j;
+  int r;
+
+  for (i = 0; i < 2 * PGSIZE; i++)
+    src[i] = i * 7;
+
+  /* Correctness, at every alignment of both blocks. */
+  for (i = 0; i < 8; i++)
+    for (j = 0; j < 8; j++) 
+      {
+        memset (dst, 0x5a, 2 * PGSIZE);
+        memcpy (dst + i, src + j, 1000);
+        ASSERT (byte_cmp (dst + i, src + j, 1000) == 0);
+        ASSERT (dst[i + 1000] == 0x5a && (i == 0 || dst[i - 1] == 0x5a));
+        ASSERT (memcmp (dst + i, src + j, 1000) == 0);
+        dst[i + 999]++;
+        ASSERT (memcmp (dst + i, src + j, 1000) > 0);
+        memset (dst + i, 0x33, 999 - j);
+        ASSERT (dst[i] == 0x33 && dst[i + 998 - j] == 0x33);
+      }
+  copy_page (dst, src);
+  ASSERT (memcmp (dst, src, PGSIZE) == 0 && !page_is_zero (dst));
+  clear_page (dst);
+  ASSERT (page_is_zero (dst));
+
+  /* Speed. */
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++) 
+    {
+      size_t size = sizes[i];
+      uint64_t start, before, after;
+
+      printf ("%zu bytes:\n", size);
+
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        byte_copy (dst, src, size);
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        memcpy (dst, src, size);
+      after = rdtsc () - start;
+      report ("memcpy", size, before, after);
+
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        byte_set (dst, 0, size);
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        memset (dst, 0, size);
+      after = rdtsc () - start;
+      report ("memset", size, before, after);
+
+      memcpy (dst, src, size);
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        byte_cmp (dst, src, size);
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (r = 0; r < REPEAT; r++)
+        memcmp (dst, src, size);
+      after = rdtsc () - start;
+      report ("memcmp", size, before, after);
+    }
+
+  {
+    uint64_t start, before, after;
+
+    printf ("page helpers:\n");
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      memcpy (dst, src, PGSIZE);
+    before = rdtsc () - start;
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      copy_page (dst, src);
+    after = rdtsc () - start;
+    report ("copy_page", PGSIZE, before, after);
+
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      memset (dst, 0, PGSIZE);
+    before = rdtsc () - start;
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      clear_page (dst);
+    after = rdtsc () - start;
+    report ("clear_page", PGSIZE, before, after);
+
+    memset (src, 0, PGSIZE);
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      byte_cmp (dst, src, PGSIZE);
+    before = rdtsc () - start;
+    start = rdtsc ();
+    for (r = 0; r < REPEAT; r++)
+      page_is_zero (dst);
+    after = rdtsc () - start;
+    report ("page_is_zero", PGSIZE, before, after);
+  }
+
+  palloc_free_multiple (src, 2);
+  palloc_free_multiple (dst, 2);
+}
+
+/* Prints the bytes per cycle of REPEAT operations on SIZE bytes
+   that took BEFORE cycles the old way and AFTER cycles the new
+   way.  Rates are in hundredths of a byte. */
+static void
+report (const char *name, size_t size, uint64_t before, uint64_t after) 
+{
+  uint64_t bytes = (uint64_t) size * REPEAT * 100;
+
+  printf ("  %-12s %4llu.%02llu -> %4llu.%02llu bytes/cycle\n", name,
+          bytes / (before + 1) / 100, bytes / (before + 1) % 100,
+          bytes / (after + 1) / 100, bytes / (after + 1) % 100);
+}
+
+/* Byte-at-a-time copy, as memcpy() once was. */
+static void
+byte_copy (uint8_t *dst, const uint8_t *src, size_t size) 
+{
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Byte-at-a-time fill, as memset() once was. */
+static void
+byte_set (uint8_t *dst, int value, size_t size) 
+{
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+/* Byte-at-a-time comparison, as memcmp() once was. */
+static int
+byte_cmp (const uint8_t *a, const uint8_t *b, size_t size) 
+{
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
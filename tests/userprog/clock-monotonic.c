@@ -0,0 +1,21 @@
+/* Reads the monotonic clock twice and checks that it is well
+   formed and does not go backward, and that an unknown clock is
+   refused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct timespec a, b;
+
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &a) == 0, "clock_gettime");
+  CHECK (a.tv_nsec >= 0 && a.tv_nsec < 1000000000, "nanoseconds in range");
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &b) == 0, "clock_gettime again");
+  CHECK (b.tv_sec > a.tv_sec
+         || (b.tv_sec == a.tv_sec && b.tv_nsec >= a.tv_nsec),
+         "clock does not go backward");
+  CHECK (clock_gettime (-1, &a) == -1, "clock_gettime (-1)");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-monotonic) begin
+(clock-monotonic) clock_gettime
+(clock-monotonic) nanoseconds in range
+(clock-monotonic) clock_gettime again
+(clock-monotonic) clock does not go backward
+(clock-monotonic) clock_gettime (-1)
+(clock-monotonic) end
+clock-monotonic: exit(0)
+EOF
+pass;
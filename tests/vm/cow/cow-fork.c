@@ -0,0 +1,89 @@
+/* Forks a process with a large, resident and dirty data area
+   several times and reports how long each fork() takes and how
+   many frames the children used for the area.  With
+   copy-on-write, each child must find every page of the area at
+   the parent's physical address, and a write must move only the
+   page written, leaving the parent's copy intact. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256
+#define FORK_CNT 8
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+static void *phys[PAGE_CNT];
+
+/* Returns the number of pages of BUF still at the physical
+   address recorded in PHYS[]. */
+static int
+count_shared (void)
+{
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (get_phys_addr (buf + i * PAGE_SIZE) == phys[i])
+      cnt++;
+  return cnt;
+}
+
+/* Checks sharing from the child's side and returns its exit
+   status: the number of frames of its own it has for the area
+   after writing one page, or -1 if it did not share every page
+   before that. */
+static int
+child_main (void)
+{
+  if (count_shared () != PAGE_CNT)
+    return -1;
+  buf[0] = 'x';
+  if (get_phys_addr (buf) == phys[0])
+    return -1;
+  return PAGE_CNT - count_shared ();
+}
+
+void
+test_main (void)
+{
+  struct timespec a, b;
+  int frames = 0;
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+  for (i = 0; i < PAGE_CNT; i++)
+    phys[i] = get_phys_addr (buf + i * PAGE_SIZE);
+
+  for (i = 0; i < FORK_CNT; i++)
+    {
+      pid_t child;
+      int status;
+
+      clock_gettime (CLOCK_MONOTONIC, &a);
+      child = fork ("child");
+      if (child == 0)
+        exit (child_main ());
+      clock_gettime (CLOCK_MONOTONIC, &b);
+      msg ("fork latency: %lld us",
+           ((b.tv_sec - a.tv_sec) * 1000000000LL + (b.tv_nsec - a.tv_nsec))
+           / 1000);
+      status = wait (child);
+      if (status < 0)
+        fail ("child %d did not share all %d pages until written",
+              i, PAGE_CNT);
+      frames += status;
+    }
+  msg ("children shared all %d pages until written", PAGE_CNT);
+  msg ("children used %d frames of their own for %d pages each "
+       "(copying would use %d)", frames, PAGE_CNT, FORK_CNT * PAGE_CNT);
+  CHECK (frames == FORK_CNT, "one frame per page written");
+
+  CHECK (count_shared () == PAGE_CNT, "parent kept its frames");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) i)
+      fail ("parent's page %d changed", i);
+  msg ("parent's data intact");
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Fork latencies vary from run to run: require one per fork and
+# leave them out of the comparison.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+my (@latency) = grep (/^\(cow-fork\) fork latency: \d+ us$/, @output);
+fail "Expected 8 fork latencies but found " . scalar (@latency) . "\n"
+  if @latency != 8;
+@output = grep (!/^\(cow-fork\) fork latency:/, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cow-fork) begin
+(cow-fork) children shared all 256 pages until written
+(cow-fork) children used 8 frames of their own for 256 pages each (copying would use 2048)
+(cow-fork) one frame per page written
+(cow-fork) parent kept its frames
+(cow-fork) parent's data intact
+(cow-fork) end
+EOF
+pass;
@@ -0,0 +1,70 @@
+/* Spawns threads that increment a shared counter under a
+   futex-based mutex, waits on a condition variable for all of
+   them to finish, and checks that a futex wait with a timeout
+   returns once the timeout runs out. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include <synch.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4                            /* Number of threads. */
+#define ITER_CNT 5000                           /* Increments per thread. */
+#define STACK_SIZE 4096                         /* Per-thread stack. */
+
+static struct mutex lock = MUTEX_INITIALIZER;
+static struct condvar done = CONDVAR_INITIALIZER;
+static int counter;
+static int finished;
+static unsigned char stacks[THREAD_CNT][STACK_SIZE];
+
+/* Increments COUNTER ITER_CNT times, yielding the lock between
+   increments, then reports completion through DONE. */
+static void
+worker (void *aux)
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      mutex_lock (&lock);
+      counter++;
+      mutex_unlock (&lock);
+    }
+
+  mutex_lock (&lock);
+  finished++;
+  condvar_signal (&done);
+  mutex_unlock (&lock);
+  exit ((size_t) aux);
+}
+
+void
+test_main (void)
+{
+  tid_t threads[THREAD_CNT];
+  int never = 0;
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      threads[i] = thread_spawn (worker, (void *) (size_t) i,
+                                 stacks[i] + STACK_SIZE);
+      CHECK (threads[i] != TID_ERROR, "spawn thread %d", i);
+    }
+
+  mutex_lock (&lock);
+  while (finished < THREAD_CNT)
+    condvar_wait (&done, &lock);
+  mutex_unlock (&lock);
+  msg ("all threads finished");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (threads[i]) == i, "join thread %d", i);
+  CHECK (counter == THREAD_CNT * ITER_CNT, "counter is %d", counter);
+
+  CHECK (futex_wait (&never, 1, -1) == -1, "wait on changed value");
+  CHECK (futex_wait (&never, 0, 20) == -2, "wait times out");
+  CHECK (futex_wake (&never, 1) == 0, "wake with no waiters");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(futex-mutex) begin
+(futex-mutex) spawn thread 0
+(futex-mutex) spawn thread 1
+(futex-mutex) spawn thread 2
+(futex-mutex) spawn thread 3
+(futex-mutex) all threads finished
+(futex-mutex) join thread 0
+(futex-mutex) join thread 1
+(futex-mutex) join thread 2
+(futex-mutex) join thread 3
+(futex-mutex) counter is 20000
+(futex-mutex) wait on changed value
+(futex-mutex) wait times out
+(futex-mutex) wake with no waiters
+(futex-mutex) end
+EOF
+pass;
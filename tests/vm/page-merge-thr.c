@@ -0,0 +1,150 @@
+/* Generates about 1 MB of random data that is then divided into
+   8 chunks.  A separate thread of this process sorts each chunk
+   in place; the threads run in parallel and share the buffer,
+   so unlike page-merge-par no chunk is copied through a file.
+   Then we merge the chunks and verify that the result is what it
+   should be. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE (128 * 1024)
+#define CHUNK_CNT 8                             /* Number of chunks. */
+#define DATA_SIZE (CHUNK_CNT * CHUNK_SIZE)      /* Buffer size. */
+#define STACK_SIZE 4096                         /* Per-thread stack. */
+
+unsigned char buf1[DATA_SIZE], buf2[DATA_SIZE];
+size_t histogram[256];
+
+/* Per-chunk sorting state, private to the thread sorting it. */
+size_t chunk_histogram[CHUNK_CNT][256];
+unsigned char stacks[CHUNK_CNT][STACK_SIZE];
+
+/* Initialize buf1 with random data,
+   then count the number of instances of each value within it. */
+static void
+init (void)
+{
+  struct arc4 arc4;
+  size_t i;
+
+  msg ("init");
+
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, buf1, sizeof buf1);
+  for (i = 0; i < sizeof buf1; i++)
+    histogram[buf1[i]]++;
+}
+
+/* Sorts chunk number (size_t) AUX of buf1 in place, using
+   counting sort. */
+static void
+sort_chunk (void *aux)
+{
+  size_t chunk = (size_t) aux;
+  unsigned char *data = buf1 + CHUNK_SIZE * chunk;
+  size_t *hist = chunk_histogram[chunk];
+  unsigned char *p;
+  size_t i;
+
+  for (i = 0; i < CHUNK_SIZE; i++)
+    hist[data[i]]++;
+  p = data;
+  for (i = 0; i < 256; i++)
+    {
+      size_t j = hist[i];
+      while (j-- > 0)
+        *p++ = i;
+    }
+  exit (chunk);
+}
+
+/* Sort each chunk of buf1 in its own thread. */
+static void
+sort_chunks (void)
+{
+  tid_t threads[CHUNK_CNT];
+  size_t i;
+
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      msg ("sort chunk %zu", i);
+      threads[i] = thread_spawn (sort_chunk, (void *) i,
+                                 stacks[i] + STACK_SIZE);
+      CHECK (threads[i] != TID_ERROR, "spawn thread %zu", i);
+    }
+
+  for (i = 0; i < CHUNK_CNT; i++)
+    CHECK (thread_join (threads[i]) == (int) i, "join thread %zu", i);
+}
+
+/* Merge the sorted chunks in buf1 into a fully sorted buf2. */
+static void
+merge (void)
+{
+  unsigned char *mp[CHUNK_CNT];
+  size_t mp_left;
+  unsigned char *op;
+  size_t i;
+
+  msg ("merge");
+
+  /* Initialize merge pointers. */
+  mp_left = CHUNK_CNT;
+  for (i = 0; i < CHUNK_CNT; i++)
+    mp[i] = buf1 + CHUNK_SIZE * i;
+
+  /* Merge. */
+  op = buf2;
+  while (mp_left > 0)
+    {
+      /* Find smallest value. */
+      size_t min = 0;
+      for (i = 1; i < mp_left; i++)
+        if (*mp[i] < *mp[min])
+          min = i;
+
+      /* Append value to buf2. */
+      *op++ = *mp[min];
+
+      /* Advance merge pointer.
+         Delete this chunk from the set if it's emptied. */
+      if ((++mp[min] - buf1) % CHUNK_SIZE == 0)
+        mp[min] = mp[--mp_left];
+    }
+}
+
+static void
+verify (void)
+{
+  size_t buf_idx;
+  size_t hist_idx;
+
+  msg ("verify");
+
+  buf_idx = 0;
+  for (hist_idx = 0; hist_idx < sizeof histogram / sizeof *histogram;
+       hist_idx++)
+    {
+      while (histogram[hist_idx]-- > 0)
+        {
+          if (buf2[buf_idx] != hist_idx)
+            fail ("bad value %d in byte %zu", buf2[buf_idx], buf_idx);
+          buf_idx++;
+        }
+    }
+
+  msg ("success, buf_idx=%'zu", buf_idx);
+}
+
+void
+test_main (void)
+{
+  init ();
+  sort_chunks ();
+  merge ();
+  verify ();
+}
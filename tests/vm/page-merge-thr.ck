@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-merge-thr) begin
+(page-merge-thr) init
+(page-merge-thr) sort chunk 0
+(page-merge-thr) spawn thread 0
+(page-merge-thr) sort chunk 1
+(page-merge-thr) spawn thread 1
+(page-merge-thr) sort chunk 2
+(page-merge-thr) spawn thread 2
+(page-merge-thr) sort chunk 3
+(page-merge-thr) spawn thread 3
+(page-merge-thr) sort chunk 4
+(page-merge-thr) spawn thread 4
+(page-merge-thr) sort chunk 5
+(page-merge-thr) spawn thread 5
+(page-merge-thr) sort chunk 6
+(page-merge-thr) spawn thread 6
+(page-merge-thr) sort chunk 7
+(page-merge-thr) spawn thread 7
+(page-merge-thr) join thread 0
+(page-merge-thr) join thread 1
+(page-merge-thr) join thread 2
+(page-merge-thr) join thread 3
+(page-merge-thr) join thread 4
+(page-merge-thr) join thread 5
+(page-merge-thr) join thread 6
+(page-merge-thr) join thread 7
+(page-merge-thr) merge
+(page-merge-thr) verify
+(page-merge-thr) success, buf_idx=1,048,576
+(page-merge-thr) end
+EOF
+pass;
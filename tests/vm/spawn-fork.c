@@ -0,0 +1,91 @@
+/* Compares the cost of starting and reaping a thread with
+   thread_spawn() and thread_join() against that of a child
+   process with fork() and wait(), for a process with a resident
+   data area, and reports the average of each.  Then has several
+   threads spawn and join threads of their own at the same time,
+   to check that concurrent spawns each get their own thread. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64                     /* Resident data pages. */
+#define ROUND_CNT 16                    /* Creations timed per method. */
+#define SPAWNER_CNT 4                   /* Concurrent spawners. */
+#define STACK_SIZE 4096                 /* Per-thread stack. */
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+static unsigned char stacks[2 * SPAWNER_CNT][STACK_SIZE];
+
+/* Returns the nanoseconds from A to B. */
+static long long
+elapsed_ns (const struct timespec *a, const struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Exits with (int) AUX as the status. */
+static void
+leaf (void *aux)
+{
+  exit ((int) (size_t) aux);
+}
+
+/* Spawns a thread of its own that exits with a status derived
+   from spawner number (size_t) AUX, joins it, and exits with
+   what the join returned. */
+static void
+spawner (void *aux)
+{
+  size_t i = (size_t) aux;
+  tid_t tid = thread_spawn (leaf, (void *) (100 + i),
+                            stacks[SPAWNER_CNT + i] + STACK_SIZE);
+
+  exit (tid != TID_ERROR ? thread_join (tid) : -1);
+}
+
+void
+test_main (void)
+{
+  struct timespec a, b;
+  tid_t spawners[SPAWNER_CNT];
+  long long spawn_ns = 0, fork_ns = 0;
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      tid_t tid;
+      pid_t child;
+
+      clock_gettime (CLOCK_MONOTONIC, &a);
+      tid = thread_spawn (leaf, (void *) (size_t) i, stacks[0] + STACK_SIZE);
+      if (tid == TID_ERROR || thread_join (tid) != i)
+        fail ("thread %d did not run", i);
+      clock_gettime (CLOCK_MONOTONIC, &b);
+      spawn_ns += elapsed_ns (&a, &b);
+
+      clock_gettime (CLOCK_MONOTONIC, &a);
+      child = fork ("child");
+      if (child == 0)
+        exit (i);
+      if (child == PID_ERROR || wait (child) != i)
+        fail ("child %d did not run", i);
+      clock_gettime (CLOCK_MONOTONIC, &b);
+      fork_ns += elapsed_ns (&a, &b);
+    }
+  msg ("spawn+join: %lld us", spawn_ns / ROUND_CNT / 1000);
+  msg ("fork+wait: %lld us", fork_ns / ROUND_CNT / 1000);
+
+  for (i = 0; i < SPAWNER_CNT; i++)
+    {
+      spawners[i] = thread_spawn (spawner, (void *) (size_t) i,
+                                  stacks[i] + STACK_SIZE);
+      CHECK (spawners[i] != TID_ERROR, "spawn spawner %d", i);
+    }
+  for (i = 0; i < SPAWNER_CNT; i++)
+    CHECK (thread_join (spawners[i]) == 100 + i, "join spawner %d", i);
+}
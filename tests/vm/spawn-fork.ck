@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Creation times vary from run to run: require one of each and
+# leave them out of the comparison.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+foreach my $what ('spawn\+join', 'fork\+wait') {
+    fail "Expected one $what time\n"
+      if grep (/^\(spawn-fork\) $what: \d+ us$/, @output) != 1;
+}
+@output = grep (!/^\(spawn-fork\) (spawn\+join|fork\+wait):/, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(spawn-fork) begin
+(spawn-fork) spawn spawner 0
+(spawn-fork) spawn spawner 1
+(spawn-fork) spawn spawner 2
+(spawn-fork) spawn spawner 3
+(spawn-fork) join spawner 0
+(spawn-fork) join spawner 1
+(spawn-fork) join spawner 2
+(spawn-fork) join spawner 3
+(spawn-fork) end
+EOF
+pass;
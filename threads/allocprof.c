@@ -0,0 +1,143 @@
+#include "threads/allocprof.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Per-callsite allocation profile.
+
+   Each allocation is charged to a "site": the address that
+   called malloc() or palloc_get_*(), together with the allocator
+   and the size class it was served from.  Sites live in a fixed
+   open-addressed hash table, so recording an allocation costs a
+   hash and a short probe with interrupts off, and never
+   allocates memory itself.  The allocator stores the returned
+   site number with the allocation, so a free can be charged back
+   to the site without another lookup.
+
+   The pages malloc() takes for its arenas are charged to malloc()
+   itself as a palloc site, in addition to the blocks charged to
+   malloc()'s callers, so the two kinds are listed separately. */
+
+/* Number of slots in the site table.  Must be a power of 2. */
+#define ALLOCPROF_SITES 1024
+
+/* Number of sites allocprof_dump() lists. */
+#define ALLOCPROF_TOP 16
+
+/* An allocation site. */
+struct alloc_site {
+	const void *caller;         /* Return address into the caller. */
+	size_t class;               /* Size class. */
+	enum allocprof_kind kind;   /* Allocator. */
+	long long allocs;           /* # of allocations. */
+	long long frees;            /* # of frees. */
+	size_t live_bytes;          /* Bytes currently allocated. */
+	size_t peak_bytes;          /* Most bytes ever allocated at once. */
+};
+
+bool allocprof_enabled;
+
+/* Site table.  Slot 0 is ALLOCPROF_UNTRACKED and never used. */
+static struct alloc_site sites[ALLOCPROF_SITES];
+static long long dropped;       /* Allocations that found no slot. */
+
+static const char *kind_names[ALLOCPROF_KIND_CNT] = {
+	[ALLOCPROF_MALLOC] = "malloc",
+	[ALLOCPROF_PALLOC] = "palloc",
+};
+
+/* Charges an allocation of BYTES bytes of size class CLASS from
+   allocator KIND to the site at CALLER, and returns the site's
+   number, to be passed to allocprof_free() when the allocation is
+   freed.  Returns ALLOCPROF_UNTRACKED if the site table is full. */
+uint16_t
+allocprof_alloc (enum allocprof_kind kind, const void *caller, size_t class,
+		size_t bytes) {
+	uintptr_t hash = ((uintptr_t) caller ^ (class << 7) ^ kind) * 0x9e3779b97f4a7c15ULL;
+	size_t idx = (hash >> 40) & (ALLOCPROF_SITES - 1);
+	enum intr_level old_level;
+	struct alloc_site *s = NULL;
+
+	old_level = intr_disable ();
+	for (size_t probe = 0; probe < ALLOCPROF_SITES;
+			probe++, idx = (idx + 1) & (ALLOCPROF_SITES - 1)) {
+		if (idx == ALLOCPROF_UNTRACKED)
+			continue;
+		s = &sites[idx];
+		if (s->caller == NULL) {
+			s->caller = caller;
+			s->class = class;
+			s->kind = kind;
+			break;
+		}
+		if (s->caller == caller && s->class == class && s->kind == kind)
+			break;
+		s = NULL;
+	}
+	if (s != NULL) {
+		s->allocs++;
+		s->live_bytes += bytes;
+		if (s->live_bytes > s->peak_bytes)
+			s->peak_bytes = s->live_bytes;
+	} else
+		dropped++;
+	intr_set_level (old_level);
+
+	return s != NULL ? s - sites : ALLOCPROF_UNTRACKED;
+}
+
+/* Credits BYTES freed bytes back to SITE. */
+void
+allocprof_free (uint16_t site, size_t bytes) {
+	enum intr_level old_level;
+
+	if (site == ALLOCPROF_UNTRACKED)
+		return;
+	ASSERT (site < ALLOCPROF_SITES);
+
+	old_level = intr_disable ();
+	sites[site].frees++;
+	sites[site].live_bytes -= bytes;
+	intr_set_level (old_level);
+}
+
+/* Prints the sites with the most live bytes, if profiling is on.
+   Safe to call when memory has run out: it allocates nothing.
+   Caller addresses can be turned into function names with the
+   `backtrace' utility. */
+void
+allocprof_dump (void) {
+	static bool shown[ALLOCPROF_SITES];
+	size_t live = 0;
+
+	if (!allocprof_enabled)
+		return;
+
+	for (size_t i = 0; i < ALLOCPROF_SITES; i++) {
+		live += sites[i].live_bytes;
+		shown[i] = false;
+	}
+	printf ("Allocation profile: %zu bytes live, %lld allocations untracked\n",
+			live, dropped);
+	printf ("  %-18s %-6s %6s %12s %12s %10s %10s\n", "caller", "kind",
+			"class", "live", "peak", "allocs", "frees");
+	for (int n = 0; n < ALLOCPROF_TOP; n++) {
+		size_t best = ALLOCPROF_UNTRACKED;
+
+		for (size_t i = 1; i < ALLOCPROF_SITES; i++)
+			if (!shown[i] && sites[i].caller != NULL
+					&& (best == ALLOCPROF_UNTRACKED
+						|| sites[i].live_bytes > sites[best].live_bytes
+						|| (sites[i].live_bytes == sites[best].live_bytes
+							&& sites[i].peak_bytes > sites[best].peak_bytes)))
+				best = i;
+		if (best == ALLOCPROF_UNTRACKED)
+			break;
+		shown[best] = true;
+
+		struct alloc_site *s = &sites[best];
+		printf ("  %18p %-6s %6zu %12zu %12zu %10lld %10lld\n", s->caller,
+				kind_names[s->kind], s->class, s->live_bytes, s->peak_bytes,
+				s->allocs, s->frees);
+	}
+}
@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/allocprof.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -20,7 +21,11 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -31,6 +36,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/anon.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -51,6 +57,12 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -trace: Record scheduler events and dump them at power off? */
+static bool trace_sched;
+
+/* Write-Protect enable in kernel mode. */
+#define CR0_WP 0x00010000
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
@@ -85,7 +97,10 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
+	if (trace_sched)
+		trace_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -100,11 +115,13 @@ main (void) {
 #ifdef USERPROG
 	exception_init ();
 	syscall_init ();
+	process_cache_init ();
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	workqueue_init ();
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -150,21 +167,40 @@ paging_init (uint64_t mem_end) {
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = (uint64_t) &start;
+	uint64_t text_end = (uint64_t) &_end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	// Whole 2 MB regions get a single large page each, except
+	// where the read-only kernel text starts or ends.
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
 		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		if (text_start <= va && va < text_end)
 			perm &= ~PTE_W;
 
+		if (pa % LARGE_PGSIZE == 0 && pa + LARGE_PGSIZE <= mem_end
+				&& (va + LARGE_PGSIZE <= text_start || va >= text_end
+					|| (text_start <= va && va + LARGE_PGSIZE <= text_end))) {
+			if ((pte = pml4e_walk_pde (pml4, va, 1)) != NULL)
+				*pte = pa | perm | PTE_PS;
+			pa += LARGE_PGSIZE;
+			continue;
+		}
+
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+
+	// Make the kernel honor read-only user mappings too, so that
+	// its writes into pages shared copy-on-write fault like the
+	// user's own.
+	lcr0 (rcr0 () | CR0_WP);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -221,6 +257,16 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-cfs"))
+			thread_cfs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-tcache"))
+			thread_cache_max = atoi (value);
+		else if (!strcmp (name, "-trace"))
+			trace_sched = true;
+		else if (!strcmp (name, "-allocprof"))
+			allocprof_enabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -230,6 +276,8 @@ parse_options (char **argv) {
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
 	}
+	if (thread_mlfqs && thread_cfs)
+		PANIC ("-mlfqs and -cfs are mutually exclusive");
 
 	return argv;
 }
@@ -326,6 +374,11 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -cfs               Use completely fair (virtual runtime) scheduler.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -tcache=COUNT      Keep up to COUNT dead thread pages for reuse.\n"
+			"  -trace             Record scheduler events, dump them at power off.\n"
+			"  -allocprof         Profile kernel allocations by caller, dump at power off.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -342,6 +395,8 @@ power_off (void) {
 	filesys_done ();
 #endif
 
+	trace_dump ();
+	allocprof_dump ();
 	print_stats ();
 
 	printf ("Powering off...\n");
@@ -354,8 +409,14 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	workqueue_print_stats ();
+	palloc_print_stats ();
+	kmem_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+#endif
+#ifdef VM
+	anon_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocprof.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,14 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   When allocation profiling is on, every block carries a hidden
+   PROF_HDR-byte header in front of the caller's memory that
+   records the callsite the block is charged to. */
+
+/* Size of the hidden profiling header. */
+#define PROF_HDR sizeof (uint64_t)
 
 /* Descriptor. */
 struct desc {
@@ -63,6 +71,10 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_at (size_t size, const void *caller);
+static void *block_alloc (size_t size);
+static void block_free (void *);
+static size_t block_size (void *block);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -83,13 +95,36 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
-	struct desc *d;
-	struct block *b;
-	struct arena *a;
+	return malloc_at (size, __builtin_return_address (0));
+}
+
+/* Does the work of malloc() on behalf of CALLER. */
+static void *
+malloc_at (size_t size, const void *caller) {
+	uint8_t *p;
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
 		return NULL;
+	if (!allocprof_enabled)
+		return block_alloc (size);
+
+	p = block_alloc (size + PROF_HDR);
+	if (p != NULL) {
+		*(uint64_t *) p = allocprof_alloc (ALLOCPROF_MALLOC, caller,
+				block_size (p), block_size (p));
+		p += PROF_HDR;
+	}
+	return p;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, SIZE
+   nonzero.  Returns a null pointer if memory is not available. */
+static void *
+block_alloc (size_t size) {
+	struct desc *d;
+	struct block *b;
+	struct arena *a;
 
 	/* Find the smallest descriptor that satisfies a SIZE-byte
 	   request. */
@@ -156,7 +191,7 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_at (size, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -173,6 +208,15 @@ block_size (void *block) {
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes the caller may use at P, which was
+   returned by malloc(). */
+static size_t
+usable_size (void *p) {
+	if (allocprof_enabled)
+		return block_size ((uint8_t *) p - PROF_HDR) - PROF_HDR;
+	return block_size (p);
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -185,9 +229,9 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = malloc_at (new_size, __builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
-			size_t old_size = block_size (old_block);
+			size_t old_size = usable_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
 			free (old_block);
@@ -200,6 +244,16 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
+	if (p != NULL && allocprof_enabled) {
+		p = (uint8_t *) p - PROF_HDR;
+		allocprof_free (*(uint64_t *) p, block_size (p));
+	}
+	block_free (p);
+}
+
+/* Frees block P, as returned by block_alloc(). */
+static void
+block_free (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
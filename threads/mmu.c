@@ -8,6 +8,28 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces the large page mapped by PDE, which covers VA, with a
+ * page table of 4 kB PTEs that map the same memory with the same
+ * permissions, accessed and dirty bits.  Returns false if no page
+ * is available for the page table. */
+static bool
+split_large (uint64_t *pde, const uint64_t va) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	invlpg (va);
+	return true;
+}
+
+/* A large page's PDE is its own leaf entry, so it is returned in
+ * place of a PTE, unless CREATE asks for a 4 kB PTE to change, in
+ * which case the large page is split first. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -22,6 +44,11 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 					return NULL;
 			} else
 				return NULL;
+		} else if (pdp[idx] & PTE_PS) {
+			if (!create)
+				return &pdp[idx];
+			if (!split_large (&pdp[idx], va))
+				return NULL;
 		}
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
@@ -88,6 +115,28 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, creating the page map levels above it if
+ * CREATE is true.  Returns a null pointer if they are missing and
+ * CREATE is false, or if memory allocation fails. */
+uint64_t *
+pml4e_walk_pde (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *table = pml4;
+	int idx[2] = { PML4 (va), PDPE (va) };
+
+	for (int level = 0; level < 2; level++) {
+		uint64_t *e = &table[idx[level]];
+		if (!(*e & PTE_P)) {
+			uint64_t *new_page = create ? palloc_get_page (PAL_ZERO) : NULL;
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*e));
+	}
+	return &table[PDX (va)];
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,10 +171,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+		if (((uint64_t) pte) & PTE_P) {
+			if (pdp[i] & PTE_PS) {
+				/* FUNC sees a large page once, at its base. */
+				void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+									 ((uint64_t) pdp_index << PDPESHIFT) |
+									 ((uint64_t) i << PDXSHIFT));
+				if (!func (&pdp[i], va, aux))
+					return false;
+			} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
+		}
 	}
 	return true;
 }
@@ -169,8 +226,12 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		if (((uint64_t) pte) & PTE_P) {
+			/* A large page's frames belong to the frame table,
+			   which frees them one by one. */
+			if (!(pdp[i] & PTE_PS))
+				pt_destroy (PTE_ADDR (pte));
+		}
 	}
 	palloc_free_page ((void *) pdp);
 }
@@ -216,8 +277,11 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & LARGE_PGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -243,29 +307,114 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
-/* Marks user virtual page UPAGE "not present" in page
- * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
-void
-pml4_clear_page (uint64_t *pml4, void *upage) {
+/* Adds a mapping in PML4 from the 2 MB user region at UPAGE to
+ * the 2 MB of physical memory at kernel virtual address KPAGE,
+ * using a single large-page entry.  Both must be 2 MB aligned.
+ * Nothing may be mapped in the region yet, nor may it have a page
+ * table.  Returns true if successful, false if it does or if
+ * memory allocation failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT (((uint64_t) upage & LARGE_PGMASK) == 0);
+	ASSERT ((vtop (kpage) & LARGE_PGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pml4e_walk_pde (pml4, (uint64_t) upage, 1);
+
+	if (pde == NULL || (*pde & PTE_P))
+		return false;
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Makes sure user virtual page UPAGE, if it is mapped in PML4,
+ * has a 4 kB page table entry of its own, splitting the large
+ * page that holds it.  Returns false if memory allocation
+ * failed. */
+bool
+pml4_split_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte != NULL && (*pte & PTE_P) && is_large_pte (pte))
+		return pml4e_walk (pml4, (uint64_t) upage, true) != NULL;
+	return true;
+}
 
+/* Marks user virtual page UPAGE "not present" in page
+ * directory PD.  Later accesses to the page will fault.  Other
+ * bits in the page table entry are preserved.  A large page
+ * holding UPAGE is split first, so only UPAGE is affected.
+ * UPAGE need not be mapped.  Returns false, changing nothing, if
+ * memory allocation for the split failed. */
+bool
+pml4_clear_page (uint64_t *pml4, void *upage) {
+	uint64_t *pte;
+
+	if (!pml4_split_page (pml4, upage))
+		return false;
+	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
 		if (rcr3 () == vtop (pml4))
 			invlpg ((uint64_t) upage);
 	}
+	return true;
+}
+
+/* Marks the whole large page holding user virtual page UPAGE in
+ * PML4 "not present", if UPAGE is in one.  Unlike
+ * pml4_clear_page(), this needs no memory, so an address space
+ * being torn down unmaps its large pages this way. */
+void
+pml4_clear_large_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde;
+	ASSERT (is_user_vaddr (upage));
+
+	pde = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pde != NULL && (*pde & PTE_P) && is_large_pte (pde)) {
+		*pde &= ~PTE_P;
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) upage);
+	}
+}
+
+/* Makes the mapping of user virtual page UPAGE in PML4 writable
+ * if WRITABLE is true, read-only otherwise.  Other bits in the
+ * page table entry are preserved.  A large page holding UPAGE is
+ * split first, so only UPAGE is affected.  Returns false if UPAGE
+ * is not mapped or if memory allocation failed. */
+bool
+pml4_set_writable (uint64_t *pml4, void *upage, bool writable) {
+	uint64_t *pte;
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte == NULL || (*pte & PTE_P) == 0)
+		return false;
+	if (is_large_pte (pte)
+			&& (pte = pml4e_walk (pml4, (uint64_t) upage, true)) == NULL)
+		return false;
+
+	if (writable)
+		*pte |= PTE_W;
+	else
+		*pte &= ~(uint64_t) PTE_W;
+	if (rcr3 () == vtop (pml4))
+		invlpg ((uint64_t) upage);
+	return true;
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
- * Returns false if PML4 contains no PTE for VPAGE. */
+ * Returns false if PML4 contains no PTE for VPAGE.
+ * For a page inside a large page, this and the functions below
+ * read and set the bits of the whole large page. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -7,8 +7,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocprof.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -24,13 +27,59 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**ORDER pages, aligned to their size in physical
+   memory, on one free list per order.  An allocation takes a
+   block of the smallest sufficient order, splitting larger blocks
+   as needed, and returns the pages it does not use; a free merges
+   a block with its buddy for as long as the buddy is free too.
+   Both take O(log n) steps.  A free block's list element lives
+   in its first page, so the only other bookkeeping is one byte
+   per page.
+
+   While the CPU would otherwise sit idle, the idle thread takes
+   single free pages out of the buddy lists, zeroes them and
+   keeps them on a separate "zeroed" list, so that PAL_ZERO
+   requests for one page need not clear it on the caller's time.
+   Zeroed pages count as allocated until they are handed out.
+   When the buddy lists run dry, other requests use them too, or
+   the ones that keep a large enough block from forming are given
+   back to the buddy lists. */
+
+/* Largest block order, 2**PALLOC_MAX_ORDER pages. */
+#define PALLOC_MAX_ORDER 10
+
+/* FREE_ORDER value for a page that does not start a free block. */
+#define NOT_FREE (-1)
+
+/* FREE_ORDER value for a page on the zeroed list. */
+#define ZEROED (-2)
+
+/* Most pages a pool keeps pre-zeroed. */
+#define PALLOC_ZEROED_MAX 256
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct spinlock lock;           /* Mutual exclusion. */
+	struct bitmap *used_map;        /* Bitmap of used pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t page_cnt;                /* Number of pages in pool. */
+	int8_t *free_order;             /* Order of free block at each page. */
+	uint16_t *site_tags;            /* Allocation site of each page, if
+	                                   profiling, else null. */
+	struct list free_lists[PALLOC_MAX_ORDER + 1];
+	unsigned free_mask;             /* Bit K set if free_lists[K] is nonempty. */
+	size_t free_blocks[PALLOC_MAX_ORDER + 1]; /* Length of each free list. */
+	size_t free_pages;              /* Total free pages. */
+	struct list zeroed;             /* Pre-zeroed single pages. */
+	size_t zeroed_cnt;              /* Length of ZEROED. */
+
+	/* Statistics. */
+	long long zero_hits;            /* PAL_ZERO served pre-zeroed. */
+	long long zero_misses;          /* PAL_ZERO cleared by the caller. */
+	long long idle_zeroed;          /* Pages zeroed by the idle thread. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +91,12 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *get_multiple (enum palloc_flags, size_t page_cnt,
+		const void *caller);
+static void *take_zeroed (struct pool *);
+static size_t drain_zeroed (struct pool *, size_t page_cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -219,16 +274,18 @@ split:
 			else
 				NOT_REACHED ();
 
-			pool_end = pool->base + bitmap_size (pool->used_map) * PGSIZE;
+			pool_end = pool->base + pool->page_cnt * PGSIZE;
 			page_idx = pg_no (start) - pg_no (pool->base);
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -253,6 +310,15 @@ palloc_init (void) {
 	return ext_mem.end;
 }
 
+/* Stores the kernel virtual address of the first page of the
+   user pool in *BASE and the number of pages in it in
+   *PAGE_CNT. */
+void
+palloc_user_pool (void **base, size_t *page_cnt) {
+	*base = user_pool.base;
+	*page_cnt = user_pool.page_cnt;
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -261,24 +327,68 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
-	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	return get_multiple (flags, page_cnt, __builtin_return_address (0));
+}
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+/* Does the work of palloc_get_multiple() on behalf of CALLER. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, const void *caller) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	bool zeroed = false;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+retry:
+	spin_lock (&pool->lock);
+	if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0) {
+		pages = take_zeroed (pool);
+		zeroed = true;
+	} else {
+		pages = buddy_alloc (pool, page_cnt);
+		if (pages != NULL) {
+			size_t page_idx = pg_no (pages) - pg_no (pool->base);
+			ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+		} else if (page_cnt == 1 && pool->zeroed_cnt > 0) {
+			pages = take_zeroed (pool);
+			zeroed = true;
+		} else if (drain_zeroed (pool, page_cnt) > 0) {
+			spin_unlock (&pool->lock);
+			goto retry;
+		}
+	}
+	if (flags & PAL_ZERO) {
+		if (zeroed)
+			pool->zero_hits++;
+		else if (pages != NULL)
+			pool->zero_misses++;
+	}
+	spin_unlock (&pool->lock);
+
+	/* Out of kernel pages: take back the slab allocator's empty
+	   slabs and try again. */
+	if (pages == NULL && pool == &kernel_pool && !intr_context ()
+			&& kmem_reclaim () > 0)
+		goto retry;
+
+	if (pages && pool->site_tags != NULL) {
+		size_t page_idx = pg_no (pages) - pg_no (pool->base);
+		uint16_t site = allocprof_alloc (ALLOCPROF_PALLOC, caller, page_cnt,
+				page_cnt * PGSIZE);
+		for (size_t i = 0; i < page_cnt; i++)
+			pool->site_tags[page_idx + i] = site;
+	}
 
 	if (pages) {
-		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
+		if (zeroed)
+			memset (pages, 0, sizeof (struct list_elem));
+		else if (flags & PAL_ZERO)
+			for (size_t i = 0; i < page_cnt; i++)
+				clear_page ((uint8_t *) pages + i * PGSIZE);
 	} else {
-		if (flags & PAL_ASSERT)
+		if (flags & PAL_ASSERT) {
+			allocprof_dump ();
 			PANIC ("palloc_get: out of pages");
+		}
 	}
 
 	return pages;
@@ -293,7 +403,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	return get_multiple (flags, 1, __builtin_return_address (0));
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -315,11 +425,20 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 
 	page_idx = pg_no (pages) - pg_no (pool->base);
 
+	if (pool->site_tags != NULL)
+		for (size_t i = 0; i < page_cnt; i++) {
+			allocprof_free (pool->site_tags[page_idx + i], PGSIZE);
+			pool->site_tags[page_idx + i] = ALLOCPROF_UNTRACKED;
+		}
+
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	spin_lock (&pool->lock);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	buddy_free (pool, page_idx, page_cnt);
+	spin_unlock (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +447,40 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Copies the page at SRC to the page at DST. */
+void
+copy_page (void *dst, const void *src) {
+	size_t cnt = PGSIZE / sizeof (uint64_t);
+
+	ASSERT (pg_ofs (dst) == 0 && pg_ofs (src) == 0);
+	asm volatile ("rep movsq"
+			: "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
+/* Fills the page at PAGE with zeros. */
+void
+clear_page (void *page) {
+	size_t cnt = PGSIZE / sizeof (uint64_t);
+
+	ASSERT (pg_ofs (page) == 0);
+	asm volatile ("rep stosq"
+			: "+D" (page), "+c" (cnt) : "a" (0ULL) : "memory");
+}
+
+/* Returns true if every byte of the page at PAGE is zero.  Tests
+   a 64-byte cache line per step. */
+bool
+page_is_zero (const void *page) {
+	const uint64_t *p = page;
+
+	ASSERT (pg_ofs (page) == 0);
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i += 8)
+		if ((p[i] | p[i + 1] | p[i + 2] | p[i + 3]
+				| p[i + 4] | p[i + 5] | p[i + 6] | p[i + 7]) != 0)
+			return false;
+	return true;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -335,14 +488,34 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t bm_size = ROUND_UP (bitmap_buf_size (pgcnt), sizeof (long));
+	size_t tags_ofs = ROUND_UP (bm_size + pgcnt, sizeof (uint16_t));
+	size_t tags_size = allocprof_enabled ? pgcnt * sizeof (uint16_t) : 0;
+	size_t bm_pages = DIV_ROUND_UP (tags_ofs + tags_size, PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	spin_lock_init (&p->lock);
+	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_size);
 	p->base = (void *) start;
+	p->page_cnt = pgcnt;
+	p->free_order = (int8_t *) *bm_base + bm_size;
+	p->site_tags = NULL;
+	if (allocprof_enabled) {
+		p->site_tags = (uint16_t *) ((uint8_t *) *bm_base + tags_ofs);
+		memset (p->site_tags, 0, tags_size);
+	}
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	memset (p->free_order, NOT_FREE, pgcnt);
+	for (int order = 0; order <= PALLOC_MAX_ORDER; order++) {
+		list_init (&p->free_lists[order]);
+		p->free_blocks[order] = 0;
+	}
+	p->free_mask = 0;
+	p->free_pages = 0;
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+	p->zero_hits = p->zero_misses = p->idle_zeroed = 0;
 
 	*bm_base += bm_pages;
 }
@@ -353,6 +526,276 @@ static bool
 page_from_pool (const struct pool *pool, void *page) {
 	size_t page_no = pg_no (page);
 	size_t start_page = pg_no (pool->base);
-	size_t end_page = start_page + bitmap_size (pool->used_map);
+	size_t end_page = start_page + pool->page_cnt;
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX in POOL on
+   its free list. */
+static void
+push_free (struct pool *pool, size_t page_idx, int order) {
+	struct list_elem *e = (struct list_elem *) (pool->base + page_idx * PGSIZE);
+
+	list_push_front (&pool->free_lists[order], e);
+	pool->free_order[page_idx] = order;
+	pool->free_mask |= 1u << order;
+	pool->free_blocks[order]++;
+	pool->free_pages += (size_t) 1 << order;
+}
+
+/* Takes the free block of 2**ORDER pages at PAGE_IDX in POOL off
+   its free list. */
+static void
+remove_free (struct pool *pool, size_t page_idx, int order) {
+	struct list_elem *e = (struct list_elem *) (pool->base + page_idx * PGSIZE);
+
+	ASSERT (pool->free_order[page_idx] == order);
+	list_remove (e);
+	pool->free_order[page_idx] = NOT_FREE;
+	if (list_empty (&pool->free_lists[order]))
+		pool->free_mask &= ~(1u << order);
+	pool->free_blocks[order]--;
+	pool->free_pages -= (size_t) 1 << order;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) {
+	size_t base_no = pg_no (pool->base);
+
+	while (order < PALLOC_MAX_ORDER) {
+		/* Blocks are aligned in physical memory, so the buddy is
+		   found from the absolute page number. */
+		size_t buddy_idx = ((base_no + page_idx) ^ ((size_t) 1 << order))
+			- base_no;
+		if (buddy_idx >= pool->page_cnt
+				|| buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+				|| pool->free_order[buddy_idx] != order)
+			break;
+		remove_free (pool, buddy_idx, order);
+		if (buddy_idx < page_idx)
+			page_idx = buddy_idx;
+		order++;
+	}
+	push_free (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that cover them. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t base_no = pg_no (pool->base);
+
+	while (page_cnt > 0) {
+		int order = 0;
+		while (order < PALLOC_MAX_ORDER
+				&& (base_no + page_idx) % ((size_t) 2 << order) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   first, or a null pointer if no free block is large enough.
+   Takes a block of the smallest order that fits, splitting a
+   larger one if need be, and gives back the pages past
+   PAGE_CNT. */
+static void *
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	unsigned candidates;
+	size_t page_idx;
+	int order = 0, found;
+
+	if (page_cnt == 0)
+		return NULL;
+	while (((size_t) 1 << order) < page_cnt)
+		if (++order > PALLOC_MAX_ORDER)
+			return NULL;
+
+	candidates = pool->free_mask & ~((1u << order) - 1);
+	if (candidates == 0)
+		return NULL;
+	found = __builtin_ctz (candidates);
+
+	page_idx = (uint8_t *) list_front (&pool->free_lists[found])
+		- pool->base;
+	page_idx /= PGSIZE;
+	remove_free (pool, page_idx, found);
+
+	/* Split down to ORDER, freeing the upper halves. */
+	while (found > order) {
+		found--;
+		push_free (pool, page_idx + ((size_t) 1 << found), found);
+	}
+
+	buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return pool->base + page_idx * PGSIZE;
+}
+
+/* Takes a page off POOL's zeroed list and returns it.  Only its
+   first bytes, which held the list element, need clearing. */
+static void *
+take_zeroed (struct pool *pool) {
+	uint8_t *page;
+
+	ASSERT (pool->zeroed_cnt > 0);
+	pool->zeroed_cnt--;
+	page = (uint8_t *) list_pop_front (&pool->zeroed);
+	pool->free_order[pg_no (page) - pg_no (pool->base)] = NOT_FREE;
+	return page;
+}
+
+/* Returns true if each of the PAGE_CNT pages of POOL starting at
+   PAGE_IDX is free or zeroed. */
+static bool
+free_or_zeroed (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	for (size_t i = page_idx; i < page_idx + page_cnt; i++)
+		if (bitmap_test (pool->used_map, i) && pool->free_order[i] != ZEROED)
+			return false;
+	return true;
+}
+
+/* Gives the zeroed pages in one aligned block big enough for
+   PAGE_CNT pages back to the buddy lists, if that makes the block
+   free, and returns how many were given back.  Zeroed pages
+   elsewhere are kept: giving them back would not let an
+   allocation of PAGE_CNT pages succeed. */
+static size_t
+drain_zeroed (struct pool *pool, size_t page_cnt) {
+	size_t base_no = pg_no (pool->base);
+	size_t block = 1, start = SIZE_MAX, cnt = 0;
+
+	while (block < page_cnt)
+		block <<= 1;
+	if (block > ((size_t) 1 << PALLOC_MAX_ORDER))
+		return 0;
+
+	/* Blocks are aligned in physical memory, like buddies. */
+	for (struct list_elem *e = list_begin (&pool->zeroed);
+			e != list_end (&pool->zeroed); e = list_next (e)) {
+		size_t block_no = pg_no (e) & ~(block - 1);
+		if (block_no >= base_no
+				&& block_no - base_no + block <= pool->page_cnt
+				&& free_or_zeroed (pool, block_no - base_no, block)) {
+			start = block_no - base_no;
+			break;
+		}
+	}
+	if (start == SIZE_MAX)
+		return 0;
+
+	for (size_t i = start; i < start + block; i++)
+		if (pool->free_order[i] == ZEROED) {
+			list_remove ((struct list_elem *) (pool->base + i * PGSIZE));
+			pool->zeroed_cnt--;
+			pool->free_order[i] = NOT_FREE;
+			bitmap_reset (pool->used_map, i);
+			buddy_free (pool, i, 1);
+			cnt++;
+		}
+	return cnt;
+}
+
+/* Fills PAGE with zeros using non-temporal stores, which bypass
+   the cache: a page zeroed ahead of time would only evict
+   useful lines, and is not read again until it is handed out. */
+static void
+clear_page_nt (void *page) {
+	uint64_t *p = page;
+
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i += 4)
+		asm volatile ("movnti %1, 0(%0)\n\t"
+				"movnti %1, 8(%0)\n\t"
+				"movnti %1, 16(%0)\n\t"
+				"movnti %1, 24(%0)"
+				: : "r" (p + i), "r" (0ULL) : "memory");
+	asm volatile ("sfence" : : : "memory");
+}
+
+/* Zeroes one free page into POOL's zeroed list, if POOL wants
+   more.  Called with interrupts off, but enables them while
+   clearing the page.  Returns true if a page was zeroed. */
+static bool
+zero_one (struct pool *pool) {
+	uint8_t *page = NULL;
+	size_t page_idx;
+
+	spin_lock (&pool->lock);
+	if (pool->zeroed_cnt < PALLOC_ZEROED_MAX
+			&& pool->zeroed_cnt < pool->free_pages) {
+		page = buddy_alloc (pool, 1);
+		if (page != NULL) {
+			page_idx = pg_no (page) - pg_no (pool->base);
+			bitmap_mark (pool->used_map, page_idx);
+		}
+	}
+	spin_unlock (&pool->lock);
+	if (page == NULL)
+		return false;
+
+	intr_enable ();
+	clear_page_nt (page);
+	intr_disable ();
+
+	spin_lock (&pool->lock);
+	list_push_back (&pool->zeroed, (struct list_elem *) page);
+	pool->free_order[page_idx] = ZEROED;
+	pool->zeroed_cnt++;
+	pool->idle_zeroed++;
+	spin_unlock (&pool->lock);
+	return true;
+}
+
+/* Called by the idle thread, with interrupts off, when there is
+   nothing else to run.  Zeroes one free page ahead of time, for
+   the kernel pool first, and returns true, or returns false if
+   both pools already have enough zeroed pages. */
+bool
+palloc_zero_idle (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	return zero_one (&kernel_pool) || zero_one (&user_pool);
+}
+
+/* Prints POOL's free pages and free blocks per order under
+   NAME.  Fragmentation is the share of free pages outside the
+   largest free block. */
+static void
+print_pool_stats (const char *name, struct pool *pool) {
+	size_t blocks[PALLOC_MAX_ORDER + 1];
+	size_t free_pages, zeroed, largest = 0;
+	long long hits, misses, idle_zeroed;
+
+	spin_lock (&pool->lock);
+	for (int order = 0; order <= PALLOC_MAX_ORDER; order++)
+		blocks[order] = pool->free_blocks[order];
+	free_pages = pool->free_pages;
+	zeroed = pool->zeroed_cnt;
+	hits = pool->zero_hits;
+	misses = pool->zero_misses;
+	idle_zeroed = pool->idle_zeroed;
+	if (pool->free_mask != 0)
+		largest = (size_t) 1 << (31 - __builtin_clz (pool->free_mask));
+	spin_unlock (&pool->lock);
+
+	printf ("%s pool: %zu of %zu pages free, %zu%% fragmented, "
+			"free blocks by order:", name, free_pages, pool->page_cnt,
+			free_pages != 0 ? (free_pages - largest) * 100 / free_pages : 0);
+	for (int order = 0; order <= PALLOC_MAX_ORDER; order++)
+		printf (" %zu", blocks[order]);
+	printf ("\n");
+	printf ("%s pool: %zu pages pre-zeroed (%lld by idle), "
+			"%lld of %lld zeroed allocations pre-zeroed\n",
+			name, zeroed, idle_zeroed, hits, hits + misses);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	print_pool_stats ("Kernel", &kernel_pool);
+	print_pool_stats ("User", &user_pool);
+}
@@ -0,0 +1,306 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   malloc() rounds every request up to a power of 2, which wastes
+   up to half of each block on the fixed-size structures the
+   kernel allocates most.  A kmem_cache instead hands out objects
+   of one exact size, carved out of single-page "slabs".
+
+   Each slab starts with a header and an array of free-list links,
+   one per object, followed by the objects.  Keeping the links out
+   of the objects lets a cache with a constructor hand objects out
+   in their constructed state: the constructor runs once, when the
+   slab is created, and callers return objects to the cache in
+   that state.
+
+   A cache keeps its slabs on three lists, by whether they are
+   partly used, full or empty.  Allocation prefers partly used
+   slabs, so objects pack into as few pages as possible.  One
+   empty slab per cache is kept for reuse; further empty slabs go
+   back to the page allocator at once, and kmem_reclaim() returns
+   the rest when the kernel pool runs dry. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Number of empty slabs a cache keeps for reuse. */
+#define SLAB_EMPTY_MAX 1
+
+/* End of a slab's free list. */
+#define SLAB_END 0xffff
+
+/* Object cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Size of each object, rounded up. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	size_t objs_ofs;            /* Offset of first object in slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+	struct lock lock;           /* Protects the lists and counters. */
+	struct list partial;        /* Slabs with used and free objects. */
+	struct list full;           /* Slabs with no free objects. */
+	struct list empty;          /* Slabs with no used objects. */
+	size_t empty_cnt;           /* Length of EMPTY. */
+	struct list_elem elem;      /* Element in all_caches. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs currently owned. */
+	size_t active;              /* Objects handed out. */
+	long long allocs;           /* # of kmem_cache_alloc() calls. */
+	long long hits;             /* Allocations that needed no new slab. */
+	long long grows;            /* # of slabs created. */
+	long long reclaims;         /* # of slabs given back. */
+};
+
+/* Slab header, at the start of each slab's page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of cache's lists. */
+	size_t inuse;               /* Objects handed out. */
+	uint16_t free;              /* First free object, or SLAB_END. */
+	uint16_t next[];            /* Next free object after each one. */
+};
+
+/* The cache that struct kmem_caches come from. */
+static struct kmem_cache cache_cache;
+
+/* All caches, for statistics and reclaim. */
+static struct list all_caches;
+
+static void cache_init (struct kmem_cache *, const char *name, size_t size,
+		kmem_ctor_func *ctor);
+
+/* Initializes the slab allocator.  The page allocator must
+   already be set up. */
+void
+kmem_init (void) {
+	list_init (&all_caches);
+	cache_init (&cache_cache, "kmem_cache", sizeof (struct kmem_cache), NULL);
+}
+
+/* Creates and returns a cache of SIZE-byte objects named NAME.
+   If CTOR is nonnull, each object is passed to it once, when the
+   slab that holds it is created.  Panics if out of memory, since
+   caches are created at boot. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor) {
+	struct kmem_cache *cache = kmem_cache_alloc (&cache_cache);
+
+	if (cache == NULL)
+		PANIC ("kmem_cache_create: out of memory");
+	cache_init (cache, name, size, ctor);
+	return cache;
+}
+
+/* Initializes CACHE and adds it to the list of all caches. */
+static void
+cache_init (struct kmem_cache *cache, const char *name, size_t size,
+		kmem_ctor_func *ctor) {
+	enum intr_level old_level;
+	size_t hdr = sizeof (struct slab);
+
+	ASSERT (size > 0);
+
+	cache->name = name;
+	cache->obj_size = ROUND_UP (size, sizeof (void *));
+	cache->objs_per_slab = (PGSIZE - hdr - sizeof (void *))
+		/ (cache->obj_size + sizeof (uint16_t));
+	cache->objs_ofs = ROUND_UP (hdr + cache->objs_per_slab * sizeof (uint16_t),
+			sizeof (void *));
+	ASSERT (cache->objs_per_slab > 0 && cache->objs_per_slab < SLAB_END);
+	ASSERT (cache->objs_ofs + cache->objs_per_slab * cache->obj_size <= PGSIZE);
+	cache->ctor = ctor;
+	lock_init (&cache->lock);
+	list_init (&cache->partial);
+	list_init (&cache->full);
+	list_init (&cache->empty);
+	cache->empty_cnt = 0;
+	cache->slab_cnt = cache->active = 0;
+	cache->allocs = cache->hits = cache->grows = cache->reclaims = 0;
+
+	old_level = intr_disable ();
+	list_push_back (&all_caches, &cache->elem);
+	intr_set_level (old_level);
+}
+
+/* Returns object IDX of slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx) {
+	return (uint8_t *) s + s->cache->objs_ofs + idx * s->cache->obj_size;
+}
+
+/* Gets a page from the page allocator and makes it an empty slab
+   of CACHE, constructing all its objects.  Returns the new slab,
+   or a null pointer if memory is not available.  Called without
+   CACHE's lock, since the constructor or the page allocator's
+   reclaim may need it. */
+static struct slab *
+slab_create (struct kmem_cache *cache) {
+	struct slab *s = palloc_get_page (0);
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+	s->magic = SLAB_MAGIC;
+	s->cache = cache;
+	s->inuse = 0;
+	s->free = 0;
+	for (i = 0; i < cache->objs_per_slab; i++) {
+		s->next[i] = i + 1 < cache->objs_per_slab ? i + 1 : SLAB_END;
+		if (cache->ctor != NULL)
+			cache->ctor (slab_obj (s, i));
+	}
+	return s;
+}
+
+/* Allocates an object from CACHE and returns it, or returns a
+   null pointer if memory is not available.  If CACHE has a
+   constructor, the object is in its constructed state. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (cache != NULL);
+
+	lock_acquire (&cache->lock);
+	cache->allocs++;
+	if (!list_empty (&cache->partial)) {
+		s = list_entry (list_front (&cache->partial), struct slab, elem);
+		cache->hits++;
+	} else if (!list_empty (&cache->empty)) {
+		s = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+		cache->empty_cnt--;
+		list_push_front (&cache->partial, &s->elem);
+		cache->hits++;
+	} else {
+		lock_release (&cache->lock);
+		s = slab_create (cache);
+		if (s == NULL)
+			return NULL;
+		lock_acquire (&cache->lock);
+		list_push_front (&cache->partial, &s->elem);
+		cache->slab_cnt++;
+		cache->grows++;
+	}
+
+	ASSERT (s->free != SLAB_END);
+	obj = slab_obj (s, s->free);
+	s->free = s->next[s->free];
+	s->inuse++;
+	cache->active++;
+	if (s->free == SLAB_END) {
+		list_remove (&s->elem);
+		list_push_front (&cache->full, &s->elem);
+	}
+	lock_release (&cache->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have come from CACHE, to CACHE.  A null
+   OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj) {
+	struct slab *s, *release = NULL;
+	size_t idx;
+
+	if (obj == NULL)
+		return;
+
+	s = pg_round_down (obj);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == cache);
+	idx = ((uint8_t *) obj - (uint8_t *) s - cache->objs_ofs) / cache->obj_size;
+	ASSERT (obj == slab_obj (s, idx));
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless
+	   it must keep its constructed state. */
+	if (cache->ctor == NULL)
+		memset (obj, 0xcc, cache->obj_size);
+#endif
+
+	lock_acquire (&cache->lock);
+	if (s->free == SLAB_END) {
+		list_remove (&s->elem);
+		list_push_front (&cache->partial, &s->elem);
+	}
+	s->next[idx] = s->free;
+	s->free = idx;
+	s->inuse--;
+	cache->active--;
+	if (s->inuse == 0) {
+		list_remove (&s->elem);
+		if (cache->empty_cnt < SLAB_EMPTY_MAX) {
+			list_push_front (&cache->empty, &s->elem);
+			cache->empty_cnt++;
+		} else {
+			cache->slab_cnt--;
+			cache->reclaims++;
+			release = s;
+		}
+	}
+	lock_release (&cache->lock);
+
+	if (release != NULL)
+		palloc_free_page (release);
+}
+
+/* Gives the empty slabs of every cache back to the page
+   allocator and returns the number of pages freed.  Caches whose
+   lock is busy, or held by the caller, are skipped, so this may
+   be called from within the page allocator. */
+size_t
+kmem_reclaim (void) {
+	size_t freed = 0;
+
+	for (struct list_elem *e = list_begin (&all_caches);
+			e != list_end (&all_caches); e = list_next (e)) {
+		struct kmem_cache *cache = list_entry (e, struct kmem_cache, elem);
+		struct list victims;
+
+		if (lock_held_by_current_thread (&cache->lock)
+				|| !lock_try_acquire (&cache->lock))
+			continue;
+		list_init (&victims);
+		while (!list_empty (&cache->empty))
+			list_push_back (&victims, list_pop_front (&cache->empty));
+		cache->slab_cnt -= cache->empty_cnt;
+		cache->reclaims += cache->empty_cnt;
+		cache->empty_cnt = 0;
+		lock_release (&cache->lock);
+
+		while (!list_empty (&victims)) {
+			palloc_free_page (list_entry (list_pop_front (&victims),
+						struct slab, elem));
+			freed++;
+		}
+	}
+	return freed;
+}
+
+/* Prints usage and hit statistics for every cache. */
+void
+kmem_print_stats (void) {
+	for (struct list_elem *e = list_begin (&all_caches);
+			e != list_end (&all_caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+		printf ("Slab %s: %zu-byte objects, %zu of %zu in use, %zu slabs, "
+				"%lld allocs (%lld hits), %lld grown, %lld reclaimed\n",
+				c->name, c->obj_size, c->active,
+				c->slab_cnt * c->objs_per_slab, c->slab_cnt,
+				c->allocs, c->hits, c->grows, c->reclaims);
+	}
+}
@@ -31,6 +31,90 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Wait queue insertions so far, to keep equal priorities FIFO. */
+static uint64_t waitq_seq;
+
+/* Orders wait queue threads by descending priority, then by
+   order of insertion. */
+static bool
+waiter_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = pheap_entry (a_, struct thread, wait_elem);
+	const struct thread *b = pheap_entry (b_, struct thread, wait_elem);
+
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	return a->wait_seq < b->wait_seq;
+}
+
+/* Initializes Q as an empty wait queue. */
+void
+waitq_init (struct waitq *q) {
+	ASSERT (q != NULL);
+
+	pheap_init (&q->heap, waiter_less, NULL);
+}
+
+/* Returns true if no thread waits on Q. */
+bool
+waitq_empty (const struct waitq *q) {
+	return pheap_empty (&q->heap);
+}
+
+/* Adds T, which is about to block, to Q behind the waiters of
+   the same priority. */
+void
+waitq_push (struct waitq *q, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->waitq == NULL);
+
+	t->wait_seq = waitq_seq++;
+	t->waitq = q;
+	pheap_insert (&q->heap, &t->wait_elem);
+}
+
+/* Returns the highest-priority thread waiting on Q, or a null
+   pointer if Q is empty. */
+struct thread *
+waitq_front (const struct waitq *q) {
+	struct pheap_elem *e = pheap_min (&q->heap);
+
+	return e != NULL ? pheap_entry (e, struct thread, wait_elem) : NULL;
+}
+
+/* Removes and returns the highest-priority thread waiting on Q,
+   or returns a null pointer if Q is empty. */
+struct thread *
+waitq_pop (struct waitq *q) {
+	struct thread *t;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	t = waitq_front (q);
+	if (t != NULL) {
+		pheap_remove (&q->heap, &t->wait_elem);
+		t->waitq = NULL;
+	}
+	return t;
+}
+
+/* Changes the priority of T, which waits on a wait queue, to
+   PRIORITY and moves T to its new place in the queue.  Like a
+   new arrival, T goes behind the waiters of its new priority. */
+void
+waitq_requeue (struct thread *t, int priority) {
+	struct waitq *q = t->waitq;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (q != NULL);
+
+	pheap_remove (&q->heap, &t->wait_elem);
+	t->priority = priority;
+	t->waitq = NULL;
+	waitq_push (q, t);
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -46,11 +130,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
-}
-
-static bool compare_priority(const struct list_elem * a, const struct list_elem *b, void *aux UNUSED){
-    return (list_entry(a,struct thread, elem)->priority > list_entry(b,struct thread, elem)->priority);
+	waitq_init (&sema->waiters);
 }
 
 
@@ -71,8 +151,7 @@ sema_down (struct semaphore *sema) {
 
 	old_level = intr_disable ();
 	while (sema->value == 0) {
-		list_push_back (&sema->waiters, &thread_current ()->elem);
-	//	list_insert_ordered(&sema->waiters,&thread_current()->elem,&compare_priority,NULL);
+		waitq_push (&sema->waiters, thread_current ());
 		thread_block ();
 	}
 	sema->value--;
@@ -104,6 +183,32 @@ sema_try_down (struct semaphore *sema) {
 	return success;
 }
 
+/* Increments SEMA's value and wakes up the highest-priority
+   thread waiting for SEMA, if any, without yielding to it.
+   Returns the thread woken, or a null pointer.  Interrupts must
+   be off. */
+static struct thread *
+sema_wake (struct semaphore *sema) {
+	struct thread *t;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	sema->value++;
+	t = waitq_pop (&sema->waiters);
+	if (t != NULL)
+		thread_unblock (t);
+	return t;
+}
+
+/* Yields the CPU if T, just woken, should preempt the current
+   thread. */
+static void
+preempt_for (struct thread *t) {
+	if (t != NULL && t->priority > thread_current ()->priority
+			&& !intr_context ())
+		thread_yield ();
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
 
@@ -111,27 +216,12 @@ sema_try_down (struct semaphore *sema) {
 void
 sema_up (struct semaphore *sema) {
 	enum intr_level old_level;
-	struct list_elem *el;
+
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	
-	sema->value++;
-	if (!list_empty (&sema->waiters)){
-		list_sort(&sema->waiters,&compare_priority,NULL);
-		el=list_pop_front (&sema->waiters);
-		thread_unblock (list_entry (el,
-					struct thread, elem));
-		if(list_entry(el, struct thread, elem)->priority > thread_current()->priority && !intr_context())
-			thread_yield();
-//		el=list_max (&sema->waiters,&compare_priority,NULL);
-//		list_remove(el);
-
-	}
-
+	preempt_for (sema_wake (sema));
 	intr_set_level (old_level);
-	
-//	thread_yield();
 }
 
 static void sema_test_helper (void *sema_);
@@ -190,7 +280,40 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
-	lock->given_priority=0;
+}
+
+/* Maximum length of a chain of lock holders that a donation
+   propagates along. */
+#define DONATION_DEPTH 8
+
+/* Raises T, which is not running, to PRIORITY.  If T is blocked
+   on a wait queue it moves to its new place there. */
+static void
+donate_to (struct thread *t, int priority) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	thread_change_priority (t, priority);
+	TRACE (TRACE_DONATE, t->tid, priority);
+}
+
+/* Donates DONOR's priority to the holder of the lock DONOR waits
+   for, and on along the chain of holders each waiting for
+   another lock.  Donation only ever raises priorities, so the
+   walk stops at the first holder that is already high enough. */
+static void
+donate_priority (struct thread *donor) {
+	int priority = donor->priority;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (int depth = 0; depth < DONATION_DEPTH
+			&& donor->waiting_lock != NULL; depth++) {
+		struct thread *holder = donor->waiting_lock->holder;
+		if (holder == NULL || holder->priority >= priority)
+			break;
+		donate_to (holder, priority);
+		donor = holder;
+	}
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -203,47 +326,22 @@ lock_init (struct lock *lock) {
    we need to sleep. */
 void
 lock_acquire (struct lock *lock) {
-	int cur_priority=thread_current()->priority;
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
 
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
-	
-	if(lock->holder != NULL){
-		if(list_empty(&lock->holder->donation_list)){//if there is no donation before
-			if(lock->holder->priority<cur_priority){//if donation needed
-				lock->holder->orig_priority=lock->holder->priority;
-				lock->holder->priority=cur_priority;
-
-	//			printf("\nfirst donation happened. orig: %d\n\n", lock->holder->orig_priority);
-				//for nested donation
-				for(struct lock *tmp=lock;tmp != NULL;tmp=tmp->holder->waiting_lock){
-					if(tmp->given_priority < cur_priority){
-						if(tmp->holder->priority < cur_priority)
-							tmp->holder->priority = cur_priority;
-						tmp->given_priority = cur_priority;
-					}
-				}
-				thread_current()->waiting_lock=lock;
-				list_push_back(&lock->holder->donation_list, &lock->elem);
-			}
-		}else if(lock->holder->orig_priority<cur_priority){//if there already was a donation before
-
-			if(lock->holder->priority < cur_priority)
-				lock->holder->priority=cur_priority;
-			if(!lock->given_priority)
-				list_push_back(&lock->holder->donation_list, &lock->elem);
-			for(struct lock *tmp=lock; tmp != NULL; tmp=tmp->holder->waiting_lock){
-				if(tmp->given_priority < cur_priority)
-					tmp->given_priority=cur_priority;
-			}
-			thread_current()->waiting_lock=lock;
-		}
-	}
-	sema_down (&lock->semaphore);
-	lock->holder = thread_current ();
-	thread_current()->waiting_lock=NULL;
 
+	old_level = intr_disable ();
+	cur->waiting_lock = lock;
+	if (!thread_mlfqs)
+		donate_priority (cur);
+	sema_down (&lock->semaphore);
+	cur->waiting_lock = NULL;
+	lock->holder = cur;
+	list_push_back (&cur->held_locks, &lock->elem);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -254,53 +352,58 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current ();
+		list_push_back (&thread_current ()->held_locks, &lock->elem);
+	}
+	intr_set_level (old_level);
 	return success;
 }
 
 
 
-static bool compare_donated_priority(const struct list_elem * a, const struct list_elem *b, void *aux UNUSED){
-    return (list_entry(a,struct lock, elem)->given_priority > list_entry(b,struct lock, elem)->given_priority);
+/* Releases LOCK, held by the current thread, without yielding
+   to the waiter it wakes.  Returns that waiter, or a null
+   pointer.  Interrupts must be off. */
+static struct thread *
+lock_drop (struct lock *lock) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lock->holder = NULL;
+	list_remove (&lock->elem);
+	if (!thread_mlfqs)
+		thread_refresh_priority (thread_current ());
+	return sema_wake (&lock->semaphore);
 }
 
 /* Releases LOCK, which must be owned by the current thread.
    This is lock_release function.
 
+   The priority donated through LOCK goes away with it; the
+   current thread drops to the highest priority still donated
+   through the other locks it holds, or to its base priority.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void
 lock_release (struct lock *lock) {
-	struct thread * cur=thread_current();
-	
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
-	lock->holder = NULL;
-
-	if(!list_empty(&cur->donation_list) && cur->orig_priority < lock->given_priority){
-	//	printf("\ncur->orig_priority: %d",cur->orig_priority);
-		list_remove(&lock->elem);
-		if(list_empty(&cur->donation_list)){
-			cur->priority=cur->orig_priority;
-
-			cur->orig_priority=0;
-		}else{
-	//		printf("\n!! priority recall to %d!!\n", thread_current()->priority);
-			cur->priority=list_entry(list_max(&cur->donation_list,&compare_donated_priority,NULL),struct lock, elem)->given_priority;
-		}
-	}
-	lock->given_priority=0;
-	sema_up (&lock->semaphore);
-	//thread_yield();
+	old_level = intr_disable ();
+	preempt_for (lock_drop (lock));
+	intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -314,16 +417,124 @@ lock_held_by_current_thread (const struct lock *lock) {
 }
 
 
-/* One semaphore in a list. */
-struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
-	struct semaphore semaphore;         /* This semaphore. */
-	int priority;
-};
+/* Initializes RW.  A readers-writer lock may be held by any
+   number of readers at once, or by a single writer.
+
+   The writer holds RW's inner lock for its whole critical
+   section, and readers pass through that lock on the way in.  So
+   readers and writers that arrive while a writer is active queue
+   on an ordinary lock: they are woken in priority order and they
+   donate their priority to the writer.  A writer that arrives
+   while readers are active takes the inner lock first, which
+   holds back new readers, and then waits for the current readers
+   to leave.  Readers must not re-acquire RW shared while they
+   hold it, since a writer may be queued in between. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	rw->readers = 0;
+	rw->writer_waiting = false;
+	sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	rw->readers++;
+	intr_set_level (old_level);
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0 && rw->writer_waiting) {
+		rw->writer_waiting = false;
+		sema_up (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it in either mode. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	while (rw->readers > 0) {
+		rw->writer_waiting = true;
+		sema_down (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (lock_held_by_current_thread (&rw->lock));
+
+	lock_release (&rw->lock);
+}
 
-static bool compare_cond_priority(const struct list_elem * a, const struct list_elem *b, void *aux UNUSED){
-    return (list_entry(a,struct semaphore_elem, elem)->priority > list_entry(b,struct semaphore_elem, elem)->priority);
+/* Initializes spinlock LOCK as unheld. */
+void
+spin_lock_init (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+
+	lock->locked = 0;
 }
+
+/* Disables interrupts and busy-waits until LOCK is ours.  May be
+   called from an interrupt handler. */
+void
+spin_lock (struct spinlock *lock) {
+	enum intr_level old_level;
+
+	ASSERT (lock != NULL);
+
+	old_level = intr_disable ();
+	while (__atomic_exchange_n (&lock->locked, 1, __ATOMIC_ACQUIRE))
+		while (lock->locked)
+			asm volatile ("pause");
+	lock->old_level = old_level;
+}
+
+/* Releases LOCK and restores the interrupt level saved by the
+   matching spin_lock(). */
+void
+spin_unlock (struct spinlock *lock) {
+	enum intr_level old_level;
+
+	ASSERT (lock != NULL);
+	ASSERT (lock->locked);
+
+	old_level = lock->old_level;
+	__atomic_store_n (&lock->locked, 0, __ATOMIC_RELEASE);
+	intr_set_level (old_level);
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -331,7 +542,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	waitq_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -356,18 +567,23 @@ cond_init (struct condition *cond) {
    we need to sleep. */
 void
 cond_wait (struct condition *cond, struct lock *lock) {
-	struct semaphore_elem waiter;
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	sema_init (&waiter.semaphore, 0);
-	list_push_back (&cond->waiters, &waiter.elem);
-	waiter.priority=thread_current()->priority;
-	lock_release (lock);
-	sema_down (&waiter.semaphore);
+	/* The current thread waits on COND itself.  It must not yield
+	   to the thread that LOCK wakes before it has blocked, or a
+	   signal could find it on COND while it is still ready to
+	   run.  Dropping LOCK may lower our priority, so join COND's
+	   queue only afterward, at the priority we block with. */
+	old_level = intr_disable ();
+	lock_drop (lock);
+	waitq_push (&cond->waiters, thread_current ());
+	thread_block ();
+	intr_set_level (old_level);
 	lock_acquire (lock);
 }
 
@@ -380,17 +596,20 @@ cond_wait (struct condition *cond, struct lock *lock) {
    interrupt handler. */
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) {
+	enum intr_level old_level;
+	struct thread *t;
+
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters)){
-		list_sort(&cond->waiters,&compare_cond_priority,NULL);
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
-	}
-	thread_yield();
+	old_level = intr_disable ();
+	t = waitq_pop (&cond->waiters);
+	if (t != NULL)
+		thread_unblock (t);
+	preempt_for (t);
+	intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -404,6 +623,6 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!waitq_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
@@ -7,3 +7,7 @@ threads_SRC += threads/palloc.c		# Page allocator.
 threads_SRC += threads/malloc.c		# Subpage allocator.
 threads_SRC += threads/start.S		# Startup code.
 threads_SRC += threads/mmu.c		    # Memory management unit related things.
+threads_SRC += threads/trace.c		# Scheduler event tracing.
+threads_SRC += threads/workqueue.c	# Deferred work.
+threads_SRC += threads/slab.c		# Object caches.
+threads_SRC += threads/allocprof.c	# Allocation profiling.
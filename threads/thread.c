@@ -9,6 +9,7 @@
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
 #include "threads/fixed-point.h"
@@ -26,14 +27,66 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of CPUs the scheduler manages.  Only the bootstrap
+   processor is brought up: there is no local APIC driver and no
+   AP startup code, so this kernel does not run on more than one
+   CPU, and there is no load balancing between run queues.  The
+   rest of the kernel also still relies on turning interrupts off
+   for mutual exclusion, which only works on one CPU. */
+#define NCPU 1
+
+/* Per-CPU scheduler state.
+
+   The run queues hold processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO queue per priority, and bit N of ready_mask
+   is set iff ready_queues[N] is not empty, so the highest ready
+   priority is found with a single bit scan.  Under the completely
+   fair scheduler the queues are unused and ready threads are
+   instead kept in cfs_tree, ordered by vruntime.  LOCK protects
+   the run queues against other CPUs; interrupts must also be
+   off. */
+struct cpu {
+	struct spinlock lock;           /* Protects the run queues. */
+	struct list ready_queues[PRI_MAX + 1];
+	uint64_t ready_mask;
+	int ready_threads;              /* # of threads on the run queues. */
+
+	struct rbtree cfs_tree;         /* Ready threads by vruntime (cfs). */
+	int64_t min_vruntime;           /* Monotonic floor of vruntimes (cfs). */
+	long cfs_weight;                /* Sum of weights in cfs_tree. */
+
+	struct thread *curr;            /* Thread running on this CPU. */
+	struct thread *idle_thread;     /* Runs when nothing else can. */
+	unsigned thread_ticks;          /* # of timer ticks since last yield. */
+	unsigned slice;                 /* Length of curr's time slice. */
+
+	/* Statistics. */
+	long long idle_ticks;           /* # of timer ticks spent idle. */
+	long long kernel_ticks;         /* # of timer ticks in kernel threads. */
+	long long user_ticks;           /* # of timer ticks in user programs. */
+};
+
+static struct cpu cpus[NCPU];
+
+/* Returns the CPU we are running on. */
+static inline struct cpu *
+this_cpu (void) {
+	return &cpus[0];
+}
+
+/* Every thread except idle, for mlfqs. */
 static struct list entire_list;
 
+/* mlfqs recent_cpu decay history.  decay_coef[E % DECAY_HISTORY]
+   is the coefficient (2*load_avg + 1) of the E'th once-per-second
+   decay, and decay_epoch counts the decays done so far.  Blocked
+   threads are not touched by the decay; they replay the decays
+   they missed from this history when they wake up. */
+#define DECAY_HISTORY 256
+static int decay_coef[DECAY_HISTORY];
+static int64_t decay_epoch;
 
-/* Idle thread. */
-static struct thread *idle_thread;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -44,29 +97,73 @@ static struct lock tid_lock;
 /* Thread destruction requests */
 static struct list destruction_req;
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Pages of destroyed threads kept for reuse by thread_create(),
+   linked through their old `struct thread' elem.  Only the header
+   is reinitialized on reuse; the stack area is not re-zeroed.
+   Interrupts must be off to touch the cache. */
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+size_t thread_cache_max = 16;
+
+/* Thread page cache statistics. */
+static long long thread_cache_hits;     /* # of pages reused. */
+static long long thread_cache_misses;   /* # of pages from palloc. */
+static long long thread_cache_frees;    /* # of pages given back. */
+
 int load_avg;
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+
+/* Completely fair scheduling.  vruntime advances by
+   CFS_UNIT * NICE_0_WEIGHT / weight per timer tick, so a thread
+   with twice the weight accrues vruntime half as fast.  Every
+   ready thread should get to run once per CFS_LATENCY ticks,
+   unless there are so many that CFS_MIN_GRANULARITY ticks each
+   does not fit. */
+#define CFS_UNIT 1024           /* vruntime of one tick at nice 0. */
+#define NICE_0_WEIGHT 1024
+#define CFS_LATENCY 8           /* Target scheduling period, in ticks. */
+#define CFS_MIN_GRANULARITY 1   /* Shortest slice, in ticks. */
+
+/* Weight of nice values -20...20, each step about 1.25x.  Nice 20
+   shares the weight of nice 19. */
+static const int nice_to_weight[41] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+	/*  20 */ 15,
+};
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static void do_schedule(int status);
+static void ready_enqueue (struct cpu *, struct thread *);
+static int ready_max_priority (struct cpu *);
+static struct thread *rq_first (struct cpu *);
+static bool vruntime_less (const struct rb_elem *, const struct rb_elem *,
+		void *aux);
 static void schedule (void);
 static tid_t allocate_tid (void);
+static struct thread *thread_page_alloc (void);
+static void thread_page_free (struct thread *);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -112,8 +209,16 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (struct cpu *c = cpus; c < cpus + NCPU; c++) {
+		spin_lock_init (&c->lock);
+		for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+			list_init (&c->ready_queues[pri]);
+		c->ready_mask = 0;
+		rb_init (&c->cfs_tree, vruntime_less, NULL);
+		c->slice = TIME_SLICE;
+	}
 	list_init (&destruction_req);
+	list_init (&thread_cache);
 	if(thread_mlfqs){
 		load_avg=0;
 		list_init(&entire_list);
@@ -123,6 +228,8 @@ thread_init (void) {
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
 	initial_thread->tid = allocate_tid ();
+	initial_thread->cpu = this_cpu ();
+	this_cpu ()->curr = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -141,46 +248,292 @@ thread_start (void) {
 	sema_down (&idle_started);
 }
 
-// used for list_sort
-static bool compare_priority(const struct list_elem * a, const struct list_elem *b, void *aux UNUSED){
-    return (list_entry(a,struct thread, elem)->priority > list_entry(b,struct thread, elem)->priority);
+/* Returns the cfs weight of T, derived from its nice value. */
+static inline int
+cfs_weight (const struct thread *t) {
+	int nice = t->nice < -20 ? -20 : t->nice > 20 ? 20 : t->nice;
+	return nice_to_weight[nice + 20];
+}
+
+/* Orders threads by vruntime for the cfs run queue. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = rb_entry (a_, struct thread, rq_elem);
+	const struct thread *b = rb_entry (b_, struct thread, rq_elem);
+	return a->vruntime < b->vruntime;
+}
+
+/* Appends T to the run queue of its priority on CPU C, or
+   inserts it by vruntime under cfs.  C's lock must be held. */
+static void
+rq_insert (struct cpu *c, struct thread *t) {
+	if (thread_cfs) {
+		rb_insert (&c->cfs_tree, &t->rq_elem);
+		c->cfs_weight += cfs_weight (t);
+	} else {
+		list_push_back (&c->ready_queues[t->priority], &t->elem);
+		c->ready_mask |= 1ULL << t->priority;
+	}
+	c->ready_threads++;
+	t->cpu = c;
+}
+
+/* Removes T from CPU C's run queue.  C's lock must be held. */
+static void
+rq_remove (struct cpu *c, struct thread *t) {
+	if (thread_cfs) {
+		rb_remove (&c->cfs_tree, &t->rq_elem);
+		c->cfs_weight -= cfs_weight (t);
+	} else {
+		list_remove (&t->elem);
+		if (list_empty (&c->ready_queues[t->priority]))
+			c->ready_mask &= ~(1ULL << t->priority);
+	}
+	c->ready_threads--;
+}
+
+/* Returns the thread that should run next on CPU C, without
+   removing it, or NULL if C's run queue is empty.  C's lock must
+   be held. */
+static struct thread *
+rq_first (struct cpu *c) {
+	if (thread_cfs) {
+		struct rb_elem *e = rb_first (&c->cfs_tree);
+		return e != NULL ? rb_entry (e, struct thread, rq_elem) : NULL;
+	} else {
+		int priority = ready_max_priority (c);
+		if (priority < 0)
+			return NULL;
+		return list_entry (list_front (&c->ready_queues[priority]),
+				struct thread, elem);
+	}
+}
+
+/* Appends T to the run queue of its priority on CPU C. */
+static void
+ready_enqueue (struct cpu *c, struct thread *t) {
+	spin_lock (&c->lock);
+	rq_insert (c, t);
+	spin_unlock (&c->lock);
+}
+
+/* Locks and returns the CPU whose run queue T belongs to, or
+   the current CPU if T has never been on a run queue.  T cannot
+   be put on or taken off that queue while the lock is held. */
+static struct cpu *
+rq_lock_thread (struct thread *t) {
+	for (;;) {
+		struct cpu *c = t->cpu != NULL ? t->cpu : this_cpu ();
+
+		spin_lock (&c->lock);
+		if (t->cpu == c || t->cpu == NULL)
+			return c;
+		spin_unlock (&c->lock);
+	}
+}
+
+/* Returns the highest priority among threads ready on CPU C,
+   or -1 if no thread is ready there. */
+static int
+ready_max_priority (struct cpu *c) {
+	uint64_t mask = c->ready_mask;
+	return mask ? (int) bsrq (mask) : -1;
+}
+
+/* Clamps an mlfqs priority into [PRI_MIN, PRI_MAX]. */
+static int
+mlfqs_priority (struct thread *t) {
+	int priority = PRI_MAX - ftoi (div_fi (t->recent_cpu, 4)) - 2 * t->nice;
+	if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	else if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	return priority;
+}
+
+/* Changes T's priority to PRIORITY.  If T is on a run queue,
+   it is moved to the queue of its new priority; if it is on a
+   wait queue, blocked or about to block, it moves to its new
+   place there.  Does not
+   preempt the running thread. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	struct cpu *c;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	/* Look at T's status only under the run queue lock, so that
+	   T is not unblocked or scheduled in the middle. */
+	c = rq_lock_thread (t);
+	if (t->priority != priority) {
+		if (t->status == THREAD_READY) {
+			rq_remove (c, t);
+			t->priority = priority;
+			rq_insert (c, t);
+		} else if (t->waitq != NULL)
+			waitq_requeue (t, priority);
+		else
+			t->priority = priority;
+	}
+	spin_unlock (&c->lock);
+}
+
+/* Advances CPU C's min_vruntime to the least vruntime among its
+   running and ready threads, never moving it backward.  C's lock
+   must be held. */
+static void
+cfs_update_min_vruntime (struct cpu *c) {
+	struct thread *first = rq_first (c);
+	int64_t vruntime;
+
+	if (c->curr != c->idle_thread) {
+		vruntime = c->curr->vruntime;
+		if (first != NULL && first->vruntime < vruntime)
+			vruntime = first->vruntime;
+	} else if (first != NULL)
+		vruntime = first->vruntime;
+	else
+		return;
+	if (vruntime > c->min_vruntime)
+		c->min_vruntime = vruntime;
+}
+
+/* Returns the time slice, in ticks, for T about to run on CPU C:
+   its weighted share of the scheduling period among T and the
+   threads ready on C.  The period stretches beyond CFS_LATENCY
+   when there are too many threads to give each
+   CFS_MIN_GRANULARITY. */
+static unsigned
+cfs_slice (struct cpu *c, struct thread *t) {
+	long weight, period, slice;
+
+	if (t == c->idle_thread)
+		return CFS_MIN_GRANULARITY;
+	weight = cfs_weight (t);
+	spin_lock (&c->lock);
+	period = CFS_LATENCY;
+	if ((c->ready_threads + 1) * CFS_MIN_GRANULARITY > period)
+		period = (c->ready_threads + 1) * CFS_MIN_GRANULARITY;
+	slice = period * weight / (c->cfs_weight + weight);
+	spin_unlock (&c->lock);
+	return slice > CFS_MIN_GRANULARITY ? slice : CFS_MIN_GRANULARITY;
+}
+
+/* Places waking thread T in CPU C's vruntime order.  A thread
+   that slept for long gets at most half a period of credit
+   rather than its whole absence, so it cannot monopolize the
+   CPU when it comes back. */
+static void
+cfs_place (struct cpu *c, struct thread *t) {
+	int64_t floor = c->min_vruntime - CFS_LATENCY * CFS_UNIT / 2;
+	if (t->vruntime < floor)
+		t->vruntime = floor;
+}
+
+/* Recomputes T's effective priority: its base priority, raised
+   to that of the highest-priority waiter on any lock T holds.
+   Each lock's waiters are in a priority wait queue, so this
+   costs one look per lock held. */
+void
+thread_refresh_priority (struct thread *t) {
+	enum intr_level old_level;
+	int priority = t->base_priority;
+
+	ASSERT (is_thread (t));
+
+	old_level = intr_disable ();
+	for (struct list_elem *e = list_begin (&t->held_locks);
+			e != list_end (&t->held_locks); e = list_next (e)) {
+		struct thread *waiter =
+			waitq_front (&list_entry (e, struct lock, elem)->semaphore.waiters);
+		if (waiter != NULL && waiter->priority > priority)
+			priority = waiter->priority;
+	}
+	thread_change_priority (t, priority);
+	intr_set_level (old_level);
+}
+
+/* Applies one once-per-second recent_cpu decay with COEF to T. */
+static void
+decay_recent_cpu (struct thread *t, int coef) {
+	t->recent_cpu = add_fi (t->recent_cpu - div_ff (t->recent_cpu, coef), t->nice);
+	t->cpu_epoch++;
+}
+
+/* Replays the recent_cpu decays T missed while it was blocked. */
+static void
+mlfqs_catch_up (struct thread *t) {
+	while (t->cpu_epoch < decay_epoch)
+		decay_recent_cpu (t, decay_coef[t->cpu_epoch % DECAY_HISTORY]);
 }
 
-//update priority of all threads. change readylist accordingly.
+//update priority of runnable threads. change run queues accordingly.
+//blocked threads are brought up to date in thread_unblock(), or once
+//a second while they wait on a wait queue.
 static void
 update_priority(void){
-	struct thread * cur;
-	int ready_cnt=0;
+	struct list runnable;
+	bool second = timer_ticks () % TIMER_FREQ == 0;
+	int ready_cnt = 0;
 	int coef=add_fi(mult_fi(load_avg,2),1);
-	int nice;
-	//coef=div_ff(coef,(add_fi(coef,1)));
-
-	struct list_elem *e=list_begin(&entire_list);
-	while(e!=list_end(&entire_list)){
-		struct list_elem *next=list_next(e);
-		cur=list_entry(e,struct thread,ent_e);
-		nice=cur->nice;
-		cur->priority=PRI_MAX-ftoi(div_fi(cur->recent_cpu,4))-2*nice;
-	//	if(cur->priority>PRI_MAX) cur->priority=PRI_MAX;
-	//	else if(cur->priority<PRI_MIN) cur->priority=PRI_MIN;
-		
-		if(timer_ticks()%TIMER_FREQ==0){
-			cur->recent_cpu=add_fi(cur->recent_cpu-div_ff(cur->recent_cpu,coef), nice);
-
-			if(cur->status == THREAD_READY || cur->status == THREAD_RUNNING){
-				ready_cnt++;
+
+	for (struct cpu *c = cpus; c < cpus + NCPU; c++) {
+		/* Drain the run queues first, highest priority first, so
+		   a thread that moves to another queue is not visited
+		   twice and equal priorities keep their order. */
+		list_init (&runnable);
+		spin_lock (&c->lock);
+		ready_cnt += c->ready_threads;
+		for (int pri = PRI_MAX; pri >= PRI_MIN; pri--)
+			while (!list_empty (&c->ready_queues[pri]))
+				list_push_back (&runnable,
+						list_pop_front (&c->ready_queues[pri]));
+		c->ready_mask = 0;
+		c->ready_threads = 0;
+		spin_unlock (&c->lock);
+
+		while (!list_empty (&runnable)) {
+			struct thread *t = list_entry (list_pop_front (&runnable),
+					struct thread, elem);
+			if (t != c->idle_thread) {
+				t->priority = mlfqs_priority (t);
+				if (second)
+					decay_recent_cpu (t, coef);
 			}
+			ready_enqueue (c, t);
+		}
+		if (c->curr != NULL && c->curr != c->idle_thread) {
+			ready_cnt++;
+			c->curr->priority = mlfqs_priority (c->curr);
+			if (second)
+				decay_recent_cpu (c->curr, coef);
 		}
-		e=next;
 	}
 
-	if(timer_ticks()%TIMER_FREQ==0){
+	if (second) {
+		decay_coef[decay_epoch % DECAY_HISTORY] = coef;
+		decay_epoch++;
 		load_avg=div_fi(add_fi(mult_fi(load_avg,59),ready_cnt),60);
-		
-		//printf("lavg:%d, %d, %d\n",ftoi(load_avg),div_fi(itof(1),60),ready_cnt);
+
+		/* A thread blocked on a wait queue is woken in priority
+		   order, so it must not keep the priority it blocked with:
+		   bring it up to date now, since blocked threads change
+		   priority only here.  Bring every other sleeper up to
+		   date before the history wraps around and overwrites
+		   decays it still needs. */
+		for (struct list_elem *e = list_begin (&entire_list);
+				e != list_end (&entire_list); e = list_next (e)) {
+			struct thread *t = list_entry (e, struct thread, ent_e);
+
+			if (t->status == THREAD_BLOCKED && t->waitq != NULL) {
+				mlfqs_catch_up (t);
+				thread_change_priority (t, mlfqs_priority (t));
+			} else if (decay_epoch % DECAY_HISTORY == 0)
+				mlfqs_catch_up (t);
+		}
 	}
-	list_sort(&ready_list,&compare_priority,NULL);
-	//if(thread_current()->priority < list_max(&ready_list, &compare_priority,NULL))
 }
 
 
@@ -190,19 +543,27 @@ update_priority(void){
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *c = this_cpu ();
 
 	/* Update statistics. */
-	if (t == idle_thread)
-		idle_ticks++;
+	if (t == c->idle_thread)
+		c->idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
-		user_ticks++;
+		c->user_ticks++;
 #endif
 	else
-		kernel_ticks++;
+		c->kernel_ticks++;
 	
+	if (thread_cfs && t != c->idle_thread) {
+		spin_lock (&c->lock);
+		t->vruntime += CFS_UNIT * NICE_0_WEIGHT / cfs_weight (t);
+		cfs_update_min_vruntime (c);
+		spin_unlock (&c->lock);
+	}
+
 	if(thread_mlfqs){
-		if(t!=idle_thread){
+		if(t!=c->idle_thread){
 			t->recent_cpu=add_fi(t->recent_cpu,1);
 			barrier();
 	//		printf("rc:%d\n",ftoi(t->recent_cpu));
@@ -214,16 +575,32 @@ thread_tick (void) {
 	}
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++c->thread_ticks >= c->slice)
 		intr_yield_on_return ();
 }
 
 
+/* Credits N timer ticks that passed without a timer interrupt
+   while the CPU was idle in tickless mode. */
+void
+thread_idle_ticks (int64_t n) {
+	this_cpu ()->idle_ticks += n;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
+	long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+
+	for (struct cpu *c = cpus; c < cpus + NCPU; c++) {
+		idle_ticks += c->idle_ticks;
+		kernel_ticks += c->kernel_ticks;
+		user_ticks += c->user_ticks;
+	}
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	printf ("Thread cache: %lld hits, %lld misses, %lld pages freed\n",
+			thread_cache_hits, thread_cache_misses, thread_cache_frees);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -249,7 +626,7 @@ thread_create (const char *name, int priority,
 
 	ASSERT (function != NULL);
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = thread_page_alloc ();
 	if (t == NULL)
 		return TID_ERROR;
 
@@ -286,6 +663,7 @@ void
 thread_block (void) {
 	ASSERT (!intr_context ());
 	ASSERT (intr_get_level () == INTR_OFF);
+	TRACE (TRACE_BLOCK, thread_current ()->tid, 0);
 	thread_current ()->status = THREAD_BLOCKED;
 	schedule ();
 }
@@ -309,11 +687,17 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	//list_push_back (&ready_list, &t->elem);
-	//list_sort(&ready_list, &compare_priority, NULL);
-	list_insert_ordered(&ready_list, &t->elem, &compare_priority, NULL);
-
+	if (thread_mlfqs && t != this_cpu ()->idle_thread) {
+		mlfqs_catch_up (t);
+		t->priority = mlfqs_priority (t);
+	}
+	if (thread_cfs)
+		cfs_place (this_cpu (), t);
+	spin_lock (&this_cpu ()->lock);
+	rq_insert (this_cpu (), t);
 	t->status = THREAD_READY;
+	spin_unlock (&this_cpu ()->lock);
+	TRACE (TRACE_UNBLOCK, t->tid, t->priority);
 
 	intr_set_level (old_level);
 }
@@ -376,8 +760,8 @@ thread_yield (void) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_insert_ordered (&ready_list, &curr->elem,&compare_priority,NULL);
+	if (curr != this_cpu ()->idle_thread)
+		ready_enqueue (this_cpu (), curr);
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
@@ -385,19 +769,12 @@ thread_yield (void) {
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
-	int highest;
 	if(thread_mlfqs) return;
-	if(thread_current()->orig_priority){
-		thread_current()->orig_priority = new_priority;
-		return;
-	}
-	thread_current ()->priority = new_priority;
-	
-	if(!list_empty(&ready_list)){
-		highest=list_entry(list_front(&ready_list),struct thread,elem)->priority;
-		if(new_priority<highest)
-			thread_yield();
-	}
+	thread_current ()->base_priority = new_priority;
+	thread_refresh_priority (thread_current ());
+
+	if(thread_current ()->priority < ready_max_priority(this_cpu ()))
+		thread_yield();
 	
 }
 
@@ -412,8 +789,8 @@ void
 thread_set_nice (int nice) {
 	struct thread *cur=thread_current();
 	cur->nice= nice;
-	cur->priority=PRI_MAX-ftoi(div_fi(cur->recent_cpu,4))-2*cur->nice;
-	list_sort(&ready_list,&compare_priority,NULL);
+	if (thread_mlfqs)
+		cur->priority=mlfqs_priority(cur);
 	thread_yield();
 }
 
@@ -442,13 +819,13 @@ thread_get_recent_cpu (void) {
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   run queues.  It is returned by next_thread_to_run() as a
+   special case when the run queues are empty. */
 static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
+	this_cpu ()->idle_thread = thread_current ();
 	sema_up (idle_started);
 
 	for (;;) {
@@ -456,6 +833,15 @@ idle (void *idle_started_ UNUSED) {
 		intr_disable ();
 		thread_block ();
 
+		/* Nothing else can run: spend the time zeroing free pages
+		   ahead of time, a page at a time, until a thread becomes
+		   ready or there is nothing left to zero. */
+		while (this_cpu ()->ready_threads == 0 && palloc_zero_idle ())
+			continue;
+		if (this_cpu ()->ready_threads != 0)
+			continue;
+		timer_tickless_enter ();
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -495,10 +881,10 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
 	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
-	t->sleep_time=0;
 	t->priority = priority;
-	t->orig_priority=0;
+	t->base_priority = priority;
 	t->waiting_lock=NULL;
+	t->waitq=NULL;
 	if(thread_mlfqs){
 		if(strcmp(name, "main")==0){
 			t->nice=0;
@@ -507,11 +893,19 @@ init_thread (struct thread *t, const char *name, int priority) {
 		       	t->nice=thread_current()->nice;
 			t->recent_cpu=thread_current()->recent_cpu;
 		}
-		t->priority=PRI_MAX-ftoi(div_fi(t->recent_cpu,4))-2*t->nice;
+		t->cpu_epoch=decay_epoch;
+		t->priority=mlfqs_priority(t);
 		if(strcmp(name,"idle")!=0)
 			list_push_back(&entire_list,&t->ent_e);
 	}
-	list_init(&t->donation_list);
+	if (thread_cfs) {
+		/* Start level with the threads already running rather
+		   than ahead of all of them. */
+		if (strcmp (name, "main") != 0)
+			t->nice = thread_current ()->nice;
+		t->vruntime = this_cpu ()->min_vruntime;
+	}
+	list_init(&t->held_locks);
 	t->magic = THREAD_MAGIC;
 }
 
@@ -522,10 +916,17 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
+	struct cpu *c = this_cpu ();
+	struct thread *t;
+
+	spin_lock (&c->lock);
+	t = rq_first (c);
+	if (t == NULL)
+		t = c->idle_thread;
 	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+		rq_remove (c, t);
+	spin_unlock (&c->lock);
+	return t;
 }
 
 /* Use iretq to launch the thread */
@@ -638,7 +1039,7 @@ do_schedule(int status) {
 			list_entry (list_pop_front (&destruction_req), struct thread, elem);
 		if(thread_mlfqs)
 			list_remove(&victim->ent_e);
-		palloc_free_page(victim);
+		thread_page_free(victim);
 	}
 	
 	thread_current ()->status = status;
@@ -654,11 +1055,19 @@ schedule (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
+	/* Catch up on ticks skipped while idle before anything else
+	   looks at the clock. */
+	if (curr == this_cpu ()->idle_thread)
+		timer_tickless_exit ();
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	next->cpu = this_cpu ();
+	this_cpu ()->curr = next;
+	this_cpu ()->thread_ticks = 0;
+	this_cpu ()->slice = thread_cfs ? cfs_slice (this_cpu (), next)
+		: TIME_SLICE;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -680,10 +1089,50 @@ schedule (void) {
 
 		/* Before switching the thread, we first save the information
 		 * of current running. */
+		TRACE (TRACE_SWITCH, curr->tid, next->tid);
 		thread_launch (next);
 	}
 }
 
+/* Returns a page for a new thread, from the thread page cache
+   if possible.  init_thread() clears the `struct thread' at its
+   bottom; the rest of a recycled page holds stale stack. */
+static struct thread *
+thread_page_alloc (void) {
+	struct thread *t = NULL;
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+	if (!list_empty (&thread_cache)) {
+		t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+		thread_cache_cnt--;
+		thread_cache_hits++;
+	} else
+		thread_cache_misses++;
+	intr_set_level (old_level);
+	if (t != NULL)
+		return t;
+
+	return palloc_get_page (PAL_ZERO);
+}
+
+/* Releases the page of destroyed thread T, keeping it in the
+   thread page cache unless the cache is at thread_cache_max. */
+static void
+thread_page_free (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* Stale pointers to T must not pass is_thread(). */
+	t->magic = 0;
+	if (thread_cache_cnt < thread_cache_max) {
+		list_push_front (&thread_cache, &t->elem);
+		thread_cache_cnt++;
+	} else {
+		thread_cache_frees++;
+		palloc_free_page (t);
+	}
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) {
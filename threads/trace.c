@@ -0,0 +1,104 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Scheduler trace buffer.
+
+   A fixed-size ring of events stamped with the time-stamp
+   counter.  Writers only disable interrupts, so recording is
+   safe from any context, including the timer interrupt and the
+   middle of schedule().  When the ring is full the oldest events
+   are overwritten.  trace_dump() prints the ring over the console
+   at power off, and utils/trace2json turns that output into a
+   Chrome trace. */
+
+/* Number of events kept.  Must be a power of 2. */
+#define TRACE_EVENTS 4096
+
+struct trace_event {
+	uint64_t tsc;               /* Time-stamp counter. */
+	int tid;                    /* Thread the event is about. */
+	int arg;                    /* Event-specific argument. */
+	enum trace_type type;       /* What happened. */
+};
+
+bool trace_enabled;
+
+static struct trace_event *trace_buf;
+static uint64_t trace_head;     /* # of events ever recorded. */
+
+/* When recording started, to calibrate the TSC at dump time. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+static const char *type_names[TRACE_TYPE_CNT] = {
+	[TRACE_SWITCH] = "switch",
+	[TRACE_BLOCK] = "block",
+	[TRACE_UNBLOCK] = "unblock",
+	[TRACE_DONATE] = "donate",
+	[TRACE_SLEEP] = "sleep",
+	[TRACE_WAKE] = "wake",
+};
+
+/* Allocates the trace buffer and starts recording. */
+void
+trace_init (void) {
+	size_t page_cnt = DIV_ROUND_UP (TRACE_EVENTS * sizeof *trace_buf, PGSIZE);
+
+	trace_buf = palloc_get_multiple (PAL_ASSERT, page_cnt);
+	trace_head = 0;
+	start_tsc = rdtsc ();
+	start_ticks = timer_ticks ();
+	trace_enabled = true;
+}
+
+/* Appends an event of TYPE about thread TID to the ring. */
+void
+trace_record (enum trace_type type, int tid, int arg) {
+	enum intr_level old_level;
+	struct trace_event *e;
+
+	ASSERT (type < TRACE_TYPE_CNT);
+
+	old_level = intr_disable ();
+	e = &trace_buf[trace_head++ & (TRACE_EVENTS - 1)];
+	e->tsc = rdtsc ();
+	e->tid = tid;
+	e->arg = arg;
+	e->type = type;
+	intr_set_level (old_level);
+}
+
+/* Prints the recorded events, oldest first, prefixed by the TSC
+   frequency estimated against the timer. */
+void
+trace_dump (void) {
+	uint64_t first, tsc_hz = 0;
+	int64_t elapsed;
+
+	if (!trace_enabled)
+		return;
+	trace_enabled = false;
+
+	elapsed = timer_ticks () - start_ticks;
+	if (elapsed > 0)
+		tsc_hz = (rdtsc () - start_tsc) / elapsed * TIMER_FREQ;
+
+	first = trace_head > TRACE_EVENTS ? trace_head - TRACE_EVENTS : 0;
+	printf ("trace: begin %"PRIu64" Hz, %"PRIu64" events, %"PRIu64" lost\n",
+			tsc_hz, trace_head - first, first);
+	for (uint64_t i = first; i < trace_head; i++) {
+		struct trace_event *e = &trace_buf[i & (TRACE_EVENTS - 1)];
+		printf ("trace: %"PRIu64" %s %d %d\n",
+				e->tsc, type_names[e->type], e->tid, e->arg);
+	}
+	printf ("trace: end\n");
+}
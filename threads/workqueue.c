@@ -0,0 +1,248 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Deferred work.
+
+   Subsystems that need something done later, or done outside
+   the context they are in (an interrupt handler, or a path that
+   must not wait for the disk), describe it with a struct work
+   embedded in one of their own objects and hand it to a
+   workqueue.  Each workqueue has a fixed pool of worker threads
+   that take work off its pending list in FIFO order and run it.
+
+   A work item that is already pending is not queued again, so
+   queueing the same item several times before it runs costs one
+   run.  Work may requeue itself from its own function; that is
+   how periodic work is written.  The owner of a work item must
+   cancel and flush it before freeing the object it lives in.
+
+   All state is protected by disabling interrupts, so work may
+   be queued from interrupt context. */
+
+/* Number of workers serving system_wq. */
+#define SYSTEM_WORKERS 2
+
+struct workqueue system_wq;
+
+/* All workqueues, for statistics. */
+static struct list all_workqueues;
+
+static thread_func worker_loop;
+static timer_func delayed_work_timeout;
+
+/* Initializes the workqueue subsystem and starts system_wq.
+   The scheduler must already be running. */
+void
+workqueue_init (void) {
+	list_init (&all_workqueues);
+	workqueue_create (&system_wq, "system", SYSTEM_WORKERS);
+}
+
+/* Initializes WQ, named NAME, and starts WORKERS threads to
+   serve it. */
+void
+workqueue_create (struct workqueue *wq, const char *name, int workers) {
+	enum intr_level old_level;
+
+	ASSERT (wq != NULL);
+	ASSERT (workers > 0);
+
+	wq->name = name;
+	list_init (&wq->pending);
+	sema_init (&wq->avail, 0);
+	waitq_init (&wq->flushers);
+	wq->queued_cnt = wq->delayed_cnt = wq->run_cnt = 0;
+	wq->wait_ticks = 0;
+	wq->depth = wq->max_depth = 0;
+
+	old_level = intr_disable ();
+	list_push_back (&all_workqueues, &wq->elem);
+	intr_set_level (old_level);
+
+	for (int i = 0; i < workers; i++) {
+		char thread_name[16];
+		snprintf (thread_name, sizeof thread_name, "kworker/%s", name);
+		thread_create (thread_name, PRI_DEFAULT, worker_loop, wq);
+	}
+}
+
+/* Prints statistics for every workqueue. */
+void
+workqueue_print_stats (void) {
+	for (struct list_elem *e = list_begin (&all_workqueues);
+			e != list_end (&all_workqueues); e = list_next (e)) {
+		struct workqueue *wq = list_entry (e, struct workqueue, elem);
+		printf ("Workqueue %s: %lld queued (%lld delayed), %lld run, "
+				"%lld ticks waiting, max depth %zu\n",
+				wq->name, wq->queued_cnt, wq->delayed_cnt, wq->run_cnt,
+				wq->wait_ticks, wq->max_depth);
+	}
+}
+
+/* Initializes W to run FUNC when queued. */
+void
+work_init (struct work *w, work_func *func) {
+	ASSERT (w != NULL);
+	ASSERT (func != NULL);
+
+	w->func = func;
+	w->wq = NULL;
+	w->pending = false;
+	w->running = 0;
+	w->timer.pending = false;
+}
+
+/* Puts W, which must be pending, on WQ's pending list.
+   Interrupts must be off. */
+static void
+enqueue (struct workqueue *wq, struct work *w) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	w->queued = timer_ticks ();
+	list_push_back (&wq->pending, &w->elem);
+	if (++wq->depth > wq->max_depth)
+		wq->max_depth = wq->depth;
+	sema_up (&wq->avail);
+}
+
+/* Queues W on WQ to run as soon as a worker is free.  Returns
+   true if W was queued, false if it was already pending.  May be
+   called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *w) {
+	enum intr_level old_level;
+	bool queued;
+
+	ASSERT (wq != NULL);
+	ASSERT (w != NULL);
+
+	old_level = intr_disable ();
+	queued = !w->pending;
+	if (queued) {
+		w->pending = true;
+		w->wq = wq;
+		wq->queued_cnt++;
+		enqueue (wq, w);
+	}
+	intr_set_level (old_level);
+	return queued;
+}
+
+/* Queues W on WQ once TICKS timer ticks have passed.  Returns
+   true if W was queued, false if it was already pending.  May be
+   called from an interrupt handler. */
+bool
+queue_delayed_work (struct workqueue *wq, struct work *w, int64_t ticks) {
+	enum intr_level old_level;
+	bool queued;
+
+	ASSERT (wq != NULL);
+	ASSERT (w != NULL);
+
+	if (ticks <= 0)
+		return queue_work (wq, w);
+
+	old_level = intr_disable ();
+	queued = !w->pending;
+	if (queued) {
+		w->pending = true;
+		w->wq = wq;
+		wq->queued_cnt++;
+		wq->delayed_cnt++;
+		timer_add (&w->timer, timer_ticks () + ticks, delayed_work_timeout, w);
+	}
+	intr_set_level (old_level);
+	return queued;
+}
+
+/* Moves delayed work AUX onto its queue when its delay is up. */
+static void
+delayed_work_timeout (struct timer *timer UNUSED, void *aux) {
+	struct work *w = aux;
+
+	enqueue (w->wq, w);
+}
+
+/* Takes W off its queue, or stops its timer, if it is pending.
+   Returns true if W was pending.  Does not wait for a run of W
+   already under way; use flush_work() for that. */
+bool
+cancel_work (struct work *w) {
+	enum intr_level old_level;
+	bool pending;
+
+	ASSERT (w != NULL);
+
+	old_level = intr_disable ();
+	pending = w->pending;
+	if (pending) {
+		if (!timer_cancel (&w->timer)) {
+			list_remove (&w->elem);
+			w->wq->depth--;
+			/* Keep AVAIL equal to the length of the pending list. */
+			sema_try_down (&w->wq->avail);
+		}
+		w->pending = false;
+	}
+	intr_set_level (old_level);
+	return pending;
+}
+
+/* Waits until W is neither pending nor running.  Delayed work
+   still waiting on its timer is queued right away rather than
+   waited for.  Must not be called by W itself. */
+void
+flush_work (struct work *w) {
+	enum intr_level old_level;
+
+	ASSERT (w != NULL);
+	ASSERT (!intr_context ());
+
+	old_level = intr_disable ();
+	if (w->pending && timer_cancel (&w->timer))
+		enqueue (w->wq, w);
+	while (w->pending || w->running > 0) {
+		waitq_push (&w->wq->flushers, thread_current ());
+		thread_block ();
+	}
+	intr_set_level (old_level);
+}
+
+/* Worker thread serving workqueue WQ_. */
+static void
+worker_loop (void *wq_) {
+	struct workqueue *wq = wq_;
+
+	for (;;) {
+		enum intr_level old_level;
+		struct work *w;
+		struct thread *t;
+
+		sema_down (&wq->avail);
+
+		old_level = intr_disable ();
+		if (list_empty (&wq->pending)) {
+			/* cancel_work() took the entry we were counted for. */
+			intr_set_level (old_level);
+			continue;
+		}
+		w = list_entry (list_pop_front (&wq->pending), struct work, elem);
+		wq->depth--;
+		wq->wait_ticks += timer_ticks () - w->queued;
+		w->pending = false;
+		w->running++;
+		intr_set_level (old_level);
+
+		w->func (w);
+
+		old_level = intr_disable ();
+		wq->run_cnt++;
+		w->running--;
+		while ((t = waitq_pop (&wq->flushers)) != NULL)
+			thread_unblock (t);
+		intr_set_level (old_level);
+	}
+}
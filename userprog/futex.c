@@ -0,0 +1,176 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+
+/* Fast user-space mutexes.
+
+   A user program keeps its lock or condition state in an int of
+   its own memory and only enters the kernel when it has to
+   sleep or to wake sleepers.  futex_wait() puts the caller to
+   sleep on the int's address, provided it still holds the value
+   the caller last saw; futex_wake() wakes sleepers on an
+   address.
+
+   Sleepers are kept in a fixed hash table of wait lists, keyed
+   by the process and the page and offset of the int, so that
+   the threads of one process meet on the same list.  Each list
+   is in descending priority order, so a wake picks the
+   highest-priority sleepers first.  All of it is protected by
+   disabling interrupts: checking the int and going to sleep must
+   be atomic with respect to futex_wake(). */
+
+#define FUTEX_BUCKETS 64        /* Number of wait lists, a power of 2. */
+
+/* Identifies a futex. */
+struct futex_key {
+	struct process *proc;       /* Process whose memory holds it. */
+	uintptr_t page;             /* User page. */
+	uintptr_t offset;           /* Offset within the page.  As wide
+	                               as the other members, so that the
+	                               key has no padding to hash. */
+};
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter {
+	struct futex_key key;
+	struct thread *thread;      /* The sleeper. */
+	int result;                 /* How the wait ended. */
+	struct timer timeout;       /* Ends the wait early, if armed. */
+	struct list_elem elem;      /* Wait list element. */
+};
+
+static struct list buckets[FUTEX_BUCKETS];
+
+/* Initializes the futex wait lists. */
+void
+futex_init (void) {
+	for (int i = 0; i < FUTEX_BUCKETS; i++)
+		list_init (&buckets[i]);
+}
+
+/* Returns the key of the futex at UADDR in the current process. */
+static struct futex_key
+futex_key (const int *uaddr) {
+	struct futex_key key = {
+		.proc = thread_current ()->proc,
+		.page = (uintptr_t) pg_round_down (uaddr),
+		.offset = pg_ofs (uaddr),
+	};
+	return key;
+}
+
+static bool
+key_equal (const struct futex_key *a, const struct futex_key *b) {
+	return a->proc == b->proc && a->page == b->page && a->offset == b->offset;
+}
+
+/* Returns the wait list for KEY. */
+static struct list *
+futex_bucket (const struct futex_key *key) {
+	return &buckets[hash_bytes (key, sizeof *key) & (FUTEX_BUCKETS - 1)];
+}
+
+static bool
+waiter_priority_greater (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct futex_waiter, elem)->thread->priority
+		> list_entry (b, struct futex_waiter, elem)->thread->priority;
+}
+
+/* Takes waiter W off its wait list and wakes it with RESULT.
+   Interrupts must be off. */
+static void
+wake_waiter (struct futex_waiter *w, int result) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_remove (&w->elem);
+	w->result = result;
+	thread_unblock (w->thread);
+}
+
+/* Timer callback that ends the wait of waiter AUX. */
+static void
+futex_timeout (struct timer *timer UNUSED, void *aux) {
+	wake_waiter (aux, FUTEX_TIMEDOUT);
+}
+
+/* Sleeps on the futex at user address UADDR if it holds
+   EXPECTED, until futex_wake() wakes us or, if TIMEOUT_MS is not
+   negative, until that many milliseconds pass.  Returns
+   FUTEX_WOKEN, FUTEX_CHANGED or FUTEX_TIMEDOUT.
+
+   UADDR must be a valid, aligned user address. */
+int
+futex_wait (int *uaddr, int expected, int64_t timeout_ms) {
+	struct futex_waiter w;
+	enum intr_level old_level;
+
+	ASSERT (is_user_vaddr (uaddr));
+	ASSERT ((uintptr_t) uaddr % sizeof *uaddr == 0);
+
+	/* The value must be checked with interrupts off, where a page
+	   fault could not be served, so fault the page in first and
+	   retry if it was evicted in between. */
+	for (;;) {
+		if (*(volatile int *) uaddr != expected)
+			return FUTEX_CHANGED;
+		old_level = intr_disable ();
+		if (pml4_get_page (thread_current ()->pml4, uaddr) != NULL)
+			break;
+		intr_set_level (old_level);
+	}
+	if (*(volatile int *) uaddr != expected) {
+		intr_set_level (old_level);
+		return FUTEX_CHANGED;
+	}
+	w.key = futex_key (uaddr);
+	w.thread = thread_current ();
+	w.timeout.pending = false;
+	list_insert_ordered (futex_bucket (&w.key), &w.elem,
+			waiter_priority_greater, NULL);
+	if (timeout_ms >= 0) {
+		int64_t ticks = DIV_ROUND_UP (timeout_ms * TIMER_FREQ, 1000);
+		timer_add (&w.timeout, timer_ticks () + ticks, futex_timeout, &w);
+	}
+	thread_block ();
+	timer_cancel (&w.timeout);
+	intr_set_level (old_level);
+	return w.result;
+}
+
+/* Wakes up to N threads sleeping on the futex at user address
+   UADDR, highest priority first.  Returns the number woken. */
+int
+futex_wake (int *uaddr, int n) {
+	struct futex_key key = futex_key (uaddr);
+	struct list *bucket = futex_bucket (&key);
+	struct thread *cur = thread_current ();
+	bool preempt = false;
+	enum intr_level old_level;
+	struct list_elem *e;
+	int woken = 0;
+
+	old_level = intr_disable ();
+	for (e = list_begin (bucket); e != list_end (bucket) && woken < n; ) {
+		struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+		e = list_next (e);
+		if (key_equal (&w->key, &key)) {
+			timer_cancel (&w->timeout);
+			wake_waiter (w, FUTEX_WOKEN);
+			if (w->thread->priority > cur->priority)
+				preempt = true;
+			woken++;
+		}
+	}
+	if (preempt)
+		thread_yield ();
+	intr_set_level (old_level);
+	return woken;
+}
@@ -19,6 +19,7 @@
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "intrinsic.h"
 #ifdef VM
 #include "vm/vm.h"
@@ -29,6 +30,7 @@ static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
+static void __do_spawn (void *);
 
 extern struct semaphore file_access;
 
@@ -38,6 +40,10 @@ struct child_pipe *get_pipe_by_tid(struct thread *t,tid_t tid){
 	struct thread *cur=t;
 	struct list_elem *p;
 	struct child_pipe *pipe;
+	/* A pipe whose child is still being created has tid 0. */
+	if(tid<=0){
+		return NULL;
+	}
 	if(list_begin(&cur->child_list)==NULL){
 		return NULL;
 	}
@@ -59,45 +65,93 @@ struct child_pipe *get_pipe_by_tid(struct thread *t,tid_t tid){
 	return NULL;
 }
 
+/* Object caches for the per-process structures allocated on
+   every fork, open and dup2. */
+static struct kmem_cache *pipe_cache;
+static struct kmem_cache *fd_cont_cache;
+static struct kmem_cache *fd_list_cache;
+
+/* Creates the caches above.  Called once at boot. */
+void process_cache_init(void){
+	pipe_cache = kmem_cache_create("child_pipe", sizeof(struct child_pipe), NULL);
+	fd_cont_cache = kmem_cache_create("fd_cont", sizeof(struct fd_cont), NULL);
+	fd_list_cache = kmem_cache_create("fd_list", sizeof(struct fd_list), NULL);
+}
+
 static struct child_pipe *allocate_pipe(void){
-	return (struct child_pipe *)malloc(sizeof(struct child_pipe));
+	return kmem_cache_alloc(pipe_cache);
 }
 
+/* What process_spawn() hands to the new thread. */
+struct spawn_args {
+	struct thread *parent;          /* Spawning thread. */
+	struct child_pipe *pipe;        /* The new thread's pipe. */
+	struct intr_frame if_;          /* User context to start in. */
+};
+
 static void free_pipe(struct child_pipe * child){
-	return free(child);
+	kmem_cache_free(pipe_cache, child);
 }
-struct fd_cont *get_cont_by_fd(struct thread *t,int fd){//get fd_cont with fd from target thread.
-	struct thread *cur=t;
+
+struct fd_cont *fd_cont_alloc(void){
+	return kmem_cache_alloc(fd_cont_cache);
+}
+
+void fd_cont_free(struct fd_cont *cont){
+	kmem_cache_free(fd_cont_cache, cont);
+}
+
+struct fd_list *fd_list_alloc(void){
+	return kmem_cache_alloc(fd_list_cache);
+}
+
+void fd_list_free(struct fd_list *fdl){
+	kmem_cache_free(fd_list_cache, fdl);
+}
+struct fd_cont *get_cont_by_fd(struct thread *t,int fd){//get fd_cont with fd from target thread's process.
+	struct list *fd_list;
 	struct list_elem *p,*fdp;
-	struct fd_cont *cont;
-	if(list_begin(&cur->fd_list)==NULL){
-		return NULL;
-	}
-	if(list_empty(&cur->fd_list)){
+	struct fd_cont *cont=NULL;
+	enum intr_level old_level;
+	if(t->proc==NULL){
 		return NULL;
 	}
-	p=list_front(&cur->fd_list);			//traverse thread's fd_list
-	while(p !=list_end(&cur->fd_list)){
-		cont=list_entry(p,struct fd_cont,elem);
-		fdp=list_front(&cont->fdl);
-		while(fdp != list_end(&cont->fdl)){
+	fd_list=&t->proc->fd_list;
+	old_level=intr_disable();		//other threads of the process share fd_list
+	for(p=list_begin(fd_list);p!=list_end(fd_list) && cont==NULL;p=list_next(p)){
+		for(fdp=list_begin(&list_entry(p,struct fd_cont,elem)->fdl);
+				fdp!=list_end(&list_entry(p,struct fd_cont,elem)->fdl);fdp=list_next(fdp)){
 			if(list_entry(fdp,struct fd_list, elem)->fd==fd){
-				return cont;
+				cont=list_entry(p,struct fd_cont,elem);
+				break;
 			}
-			fdp=list_next(fdp);
 		}
-		p=list_next(p);
 	}
-	return NULL;
+	intr_set_level(old_level);
+	return cont;
 }
 
-/* General process initializer for initd and other process. */
-static void
+/* General process initializer for initd and other process.
+ * Gives the current thread a new process of its own.  Returns
+ * false if out of memory. */
+static bool
 process_init (void) {
 	struct thread *current = thread_current ();
-	current->num_fd=2;
+	struct process *proc = (struct process *)malloc(sizeof(struct process));
 	list_init(&current->child_list);
-	list_init(&current->fd_list);
+	if(proc==NULL)
+		return false;
+	proc->refcnt=1;
+#ifdef VM
+	supplemental_page_table_init (&proc->spt);
+#endif
+	list_init(&proc->fd_list);
+	proc->num_fd=2;
+	proc->exec_file=NULL;
+	proc->parent_pipe=NULL;
+	list_init(&proc->threads);
+	current->proc=proc;
+	return true;
 }
 
 /* Starts the first userland program, called "initd", loaded from FILE_NAME.
@@ -133,23 +187,22 @@ process_create_initd (const char *file_name) {
 /* A thread function that launches first user process. */
 static void
 initd (void *f_name) {
-#ifdef VM
-	supplemental_page_table_init (&thread_current ()->spt);
-#endif
 	sema_init(&init_process.sema,0);
 	init_process.tid=thread_current()->tid;
 	init_process.exit_status=-1;
 	thread_current()->parent_pipe = &init_process.elem;
-	process_init ();
+	if (!process_init ())
+		PANIC("Fail to launch initd\n");
+	thread_current()->proc->parent_pipe = &init_process.elem;
 	
 	thread_current()->cur_dir = dir_open_root();
 
 	//allocate fd 0, 1 to STDIN, STDOUT
-	struct fd_cont *cont=(struct fd_cont *)malloc(sizeof(struct fd_cont));
+	struct fd_cont *cont=fd_cont_alloc();
 	if(cont==NULL) PANIC("Fail to launch initd\n");
-	struct fd_list *fdl=(struct fd_list *)malloc(sizeof(struct fd_list));
+	struct fd_list *fdl=fd_list_alloc();
 	if(fdl==NULL){
-		free(cont);
+		fd_cont_free(cont);
 	       	PANIC("Fail to launch initd\n");
 	}
 
@@ -158,24 +211,24 @@ initd (void *f_name) {
 	list_push_back(&cont->fdl,&fdl->elem);
 	cont->file=NULL;
 	cont->std=false;
-	list_push_back(&thread_current()->fd_list,&cont->elem);
+	list_push_back(&thread_current()->proc->fd_list,&cont->elem);
 	
-	cont=(struct fd_cont *)malloc(sizeof(struct fd_cont));
-	fdl=(struct fd_list *)malloc(sizeof(struct fd_list));
+	cont=fd_cont_alloc();
+	fdl=fd_list_alloc();
 	if(cont==NULL || fdl==NULL){
-		if(cont != NULL) free(cont);
-		if(fdl != NULL) free(fdl);
-		cont=list_entry(list_pop_front(&thread_current()->fd_list),struct fd_cont,elem);
+		if(cont != NULL) fd_cont_free(cont);
+		if(fdl != NULL) fd_list_free(fdl);
+		cont=list_entry(list_pop_front(&thread_current()->proc->fd_list),struct fd_cont,elem);
 		fdl=list_entry(list_pop_front(&cont->fdl),struct fd_list,elem);
-		free(fdl);
-		free(cont);
+		fd_list_free(fdl);
+		fd_cont_free(cont);
 	}
 	list_init(&cont->fdl);			//allocate STDOUT
 	fdl->fd=1;
 	list_push_back(&cont->fdl,&fdl->elem);
 	cont->file=NULL;
 	cont->std=true;
-	list_push_back(&thread_current()->fd_list,&cont->elem);
+	list_push_back(&thread_current()->proc->fd_list,&cont->elem);
 	if (process_exec (f_name) < 0)
 		PANIC("Fail to launch initd\n");
 	NOT_REACHED ();
@@ -234,7 +287,7 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	/* 4. TODO: Duplicate parent's page to the new page and
 	 *    TODO: check whether parent's page is writable or not (set WRITABLE
 	 *    TODO: according to the result). */
-	memcpy(newpage,parent_page,PGSIZE);
+	copy_page(newpage,parent_page);
 	writable=is_writable(pml4e_walk(parent->pml4,va,false));	
 	
 
@@ -262,17 +315,22 @@ __do_fork (void *aux) {
 	struct intr_frame *parent_if=parent->parent_if;
 	bool succ = true;
 
+	struct child_pipe *pipe=list_entry(list_back(&parent->child_list),struct child_pipe,elem);
+	ASSERT(pipe->tid==0);
+
 	/* 1. Read the cpu context to local stack. */
 	memcpy (&if_, parent_if, sizeof (struct intr_frame));
 
+	if (!process_init ())
+		goto error;
+
 	/* 2. Duplicate PT */
 	current->pml4 = pml4_create();
 	if (current->pml4 == NULL)
 		goto error;
 	process_activate (current);
 #ifdef VM
-	supplemental_page_table_init (&current->spt);
-	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
+	if (!supplemental_page_table_copy (&current->proc->spt, &parent->proc->spt))
 		goto error;
 #else
 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
@@ -289,19 +347,14 @@ __do_fork (void *aux) {
 	if_.R.rax=0;		//return value of child should be 0
 	current->cur_dir = dir_reopen(parent->cur_dir);
 	
-	struct child_pipe *pipe=list_entry(list_back(&parent->child_list),struct child_pipe,elem);
-	ASSERT(pipe->tid==0);
-	
-	process_init ();
-	
 	struct fd_cont *new_fd, *parent_fd;
 
-	if(!list_empty(&parent->fd_list)){
-		struct list_elem *pfd_elem=list_front(&parent->fd_list);
+	if(!list_empty(&parent->proc->fd_list)){
+		struct list_elem *pfd_elem=list_front(&parent->proc->fd_list);
 		do{
 			parent_fd = list_entry(pfd_elem,struct fd_cont,elem);
-			new_fd=(struct fd_cont *)malloc(sizeof(struct fd_cont));
-			if(new_fd==NULL){	//if malloc fails, free all resources(fd_cont, fd_list)
+			new_fd=fd_cont_alloc();
+			if(new_fd==NULL){	//if allocation fails, free all resources(fd_cont, fd_list)
 				goto free_res;
 			}
 			
@@ -311,7 +364,7 @@ __do_fork (void *aux) {
 			struct fd_list *parent_fdl, *fdl;
 			do{
 				parent_fdl=list_entry(parent_fde,struct fd_list,elem);
-				fdl = (struct fd_list *)malloc(sizeof(struct fd_list));
+				fdl = fd_list_alloc();
 				
 				if(fdl==NULL) goto free_res;
 
@@ -326,15 +379,16 @@ __do_fork (void *aux) {
 			}else{
 				new_fd->file = file_duplicate(parent_fd->file);
 			}
-			list_push_back(&current->fd_list,&new_fd->elem);
+			list_push_back(&current->proc->fd_list,&new_fd->elem);
 			pfd_elem=list_next(pfd_elem);	
-		}while(pfd_elem!=list_end(&parent->fd_list));
+		}while(pfd_elem!=list_end(&parent->proc->fd_list));
 	}
-	current->num_fd=parent->num_fd;
+	current->proc->num_fd=parent->proc->num_fd;
 	
 
 	pipe->tid=current->tid;
 	current->parent_pipe=&pipe->elem;
+	current->proc->parent_pipe=&pipe->elem;
 
 	sema_up(&pipe->sema);
 	/* Finally, switch to the newly created process. */
@@ -345,13 +399,13 @@ error:
 	thread_exit ();
 
 free_res:
-	while(!list_empty(&current->fd_list)){
-		new_fd=list_entry(list_pop_front(&current->fd_list),struct fd_cont,elem);//get already allocated fd_cont
+	while(!list_empty(&current->proc->fd_list)){
+		new_fd=list_entry(list_pop_front(&current->proc->fd_list),struct fd_cont,elem);//get already allocated fd_cont
 		while(!list_empty(&new_fd->fdl)){//free fd_list in fd_cont
-			free(list_entry(list_pop_front(&new_fd->fdl),struct fd_list,elem));
+			fd_list_free(list_entry(list_pop_front(&new_fd->fdl),struct fd_list,elem));
 		}
 		file_close(new_fd->file);
-		free(new_fd);
+		fd_cont_free(new_fd);
 	}
 	goto error;
 }
@@ -363,6 +417,12 @@ process_exec (void *f_name) {
 	char *file_name=f_name;
 	bool success;
 
+	/* Other threads still run in the address space we would
+	 * replace. */
+	if (thread_current ()->proc->refcnt > 1) {
+		palloc_free_page (file_name);
+		return -1;
+	}
 
 	/* We cannot use the intr_frame in the thread structure.
 	 * This is because when current thread rescheduled,
@@ -419,43 +479,179 @@ process_wait (tid_t child_tid) {
 	}
 }
 
-/* Exit the process. This function is called by thread_exit (). */
+/* Creates a new thread in the current process that starts
+ * running user code at ENTRY with ARG as its first argument and
+ * STACK as its stack pointer.  The thread shares the address
+ * space and file descriptors of the current process, which is
+ * much cheaper than process_fork().  Returns the new thread's
+ * id, or TID_ERROR if it cannot be created. */
+tid_t
+process_spawn (uintptr_t entry, uintptr_t arg, uintptr_t stack) {
+	struct thread *cur = thread_current ();
+	struct child_pipe *pipe = allocate_pipe ();
+	struct spawn_args args;
+	enum intr_level old_level;
+	tid_t tid;
+
+	if (pipe == NULL)
+		return TID_ERROR;
+	sema_init (&pipe->sema, 0);
+	pipe->exit_status = -1;
+	pipe->tid = 0;
+
+	args.parent = cur;
+	args.pipe = pipe;
+	memset (&args.if_, 0, sizeof args.if_);
+	args.if_.ds = args.if_.es = args.if_.ss = SEL_UDSEG;
+	args.if_.cs = SEL_UCSEG;
+	args.if_.eflags = FLAG_IF | FLAG_MBS;
+	args.if_.rip = entry;
+	args.if_.R.rdi = arg;
+	args.if_.rsp = stack;
+
+	old_level = intr_disable ();
+	list_push_back (&cur->proc->threads, &pipe->elem);
+	intr_set_level (old_level);
+
+	/* ARGS lives on our stack, so wait until the new thread has
+	 * copied what it needs from it. */
+	tid = thread_create (cur->name, PRI_DEFAULT, __do_spawn, &args);
+	if (tid != TID_ERROR)
+		sema_down (&pipe->sema);
+	if (pipe->tid == 0) {
+		old_level = intr_disable ();
+		list_remove (&pipe->elem);
+		intr_set_level (old_level);
+		free_pipe (pipe);
+		return TID_ERROR;
+	}
+	return tid;
+}
+
+/* A thread function that joins the creator's process and jumps
+ * to user mode. */
+static void
+__do_spawn (void *aux) {
+	struct spawn_args *args = aux;
+	struct thread *parent = args->parent;
+	struct thread *current = thread_current ();
+	struct child_pipe *pipe = args->pipe;
+	struct intr_frame if_;
+	enum intr_level old_level;
+
+	ASSERT (pipe->tid == 0);
+	memcpy (&if_, &args->if_, sizeof if_);
+
+	old_level = intr_disable ();
+	parent->proc->refcnt++;
+	intr_set_level (old_level);
+	current->proc = parent->proc;
+	current->pml4 = parent->pml4;
+	process_activate (current);
+	list_init (&current->child_list);
+	current->cur_dir = dir_reopen (parent->cur_dir);
+
+	pipe->tid = current->tid;
+	current->parent_pipe = &pipe->elem;
+	sema_up (&pipe->sema);
+	do_iret (&if_);
+	NOT_REACHED ();
+}
+
+/* Waits for thread TID of the current process, created by
+ * process_spawn(), to exit and returns its exit status.  Returns
+ * -1 immediately if TID is not such a thread or is already being
+ * joined. */
+int
+process_join (tid_t tid) {
+	struct thread *cur = thread_current ();
+	struct child_pipe *pipe = NULL;
+	enum intr_level old_level;
+	int exit_status;
+
+	/* Pipes of threads still being created have tid 0. */
+	if (tid <= 0 || tid == cur->tid)
+		return -1;
+
+	old_level = intr_disable ();
+	for (struct list_elem *e = list_begin (&cur->proc->threads);
+			e != list_end (&cur->proc->threads); e = list_next (e))
+		if (list_entry (e, struct child_pipe, elem)->tid == tid) {
+			pipe = list_entry (e, struct child_pipe, elem);
+			list_remove (e);
+			break;
+		}
+	intr_set_level (old_level);
+	if (pipe == NULL)
+		return -1;
+
+	sema_down (&pipe->sema);
+	exit_status = pipe->exit_status;
+	free_pipe (pipe);
+	return exit_status;
+}
+
+/* Exit the process. This function is called by thread_exit ().
+ * Only the last thread of a process tears down what the threads
+ * share and reports to the parent; earlier ones just wake their
+ * joiner. */
 void
 process_exit (void) {
 	struct thread *curr = thread_current ();
-	/* TODO: Your code goes here.
-	 * TODO: Implement process termination message (see
-	 * TODO: project2/process_termination.html).
-	 * TODO: We recommend you to implement process resource cleanup here. */
-	process_cleanup ();
-	if(list_begin(&curr->fd_list) != NULL){
-		while(!list_empty(&curr->fd_list)){
-			struct fd_cont *cont=list_entry(list_pop_front(&curr->fd_list), struct fd_cont,elem);
-			while(!list_empty(&cont->fdl)){
-				free(list_entry(list_pop_front(&cont->fdl),struct fd_list,elem));
-			}
-			sema_down(&file_access);
-			file_close(cont->file);
-			sema_up(&file_access);
-			free(cont);
-		}
-	}
+	struct process *proc = curr->proc;
+	enum intr_level old_level;
+	bool last;
+
 	if(list_begin(&curr->child_list) != NULL){
 		while(!list_empty(&curr->child_list)){
 			struct child_pipe *pipe=list_entry(list_pop_front(&curr->child_list),struct child_pipe,elem);
-			free(pipe);
+			free_pipe(pipe);
 		}
 	}
-	if(curr->exec_file != NULL){
+	if (proc == NULL) {
+		process_cleanup ();
+		return;
+	}
+	if (curr->parent_pipe != NULL && curr->parent_pipe != proc->parent_pipe)
+		sema_up (&list_entry (curr->parent_pipe, struct child_pipe, elem)->sema);
+
+	old_level = intr_disable ();
+	last = --proc->refcnt == 0;
+	intr_set_level (old_level);
+	if (!last) {
+		/* The address space lives on in the other threads. */
+		curr->pml4 = NULL;
+		pml4_activate (NULL);
+		curr->proc = NULL;
+		return;
+	}
+
+	process_cleanup ();
+	while(!list_empty(&proc->fd_list)){
+		struct fd_cont *cont=list_entry(list_pop_front(&proc->fd_list), struct fd_cont,elem);
+		while(!list_empty(&cont->fdl)){
+			fd_list_free(list_entry(list_pop_front(&cont->fdl),struct fd_list,elem));
+		}
+		sema_down(&file_access);
+		file_close(cont->file);
+		sema_up(&file_access);
+		fd_cont_free(cont);
+	}
+	while (!list_empty (&proc->threads))
+		free_pipe (list_entry (list_pop_front (&proc->threads),
+					struct child_pipe, elem));
+	if(proc->exec_file != NULL){
 		sema_down(&file_access);
-		file_close(curr->exec_file);
+		file_close(proc->exec_file);
 		sema_up(&file_access);
 	}
-	if(curr->parent_pipe != NULL){
-		struct child_pipe *pipe=list_entry(curr->parent_pipe,struct child_pipe, elem);
+	if(proc->parent_pipe != NULL){
+		struct child_pipe *pipe=list_entry(proc->parent_pipe,struct child_pipe, elem);
 		sema_up(&pipe->sema);
 		printf("%s: exit(%d)\n",curr->name, pipe->exit_status);
 	}
+	curr->proc = NULL;
+	free (proc);
 }
 
 /* Free the current process's resources. */
@@ -464,7 +660,8 @@ process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
 #ifdef VM
-	supplemental_page_table_kill (&curr->spt);
+	if (curr->proc != NULL)
+		supplemental_page_table_kill (&curr->proc->spt);
 #endif
 
 	uint64_t *pml4;
@@ -726,7 +923,7 @@ load (const char *file_name, struct intr_frame *if_) {
 done:
 	/* We arrive here whether the load is successful or not. */
 	if(success){
-		t->exec_file = file;
+		t->proc->exec_file = file;
 		file_deny_write(file);
 	}else{
 		file_close (file);
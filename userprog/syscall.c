@@ -1,6 +1,8 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include <time.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
@@ -12,6 +14,7 @@
 #include "threads/palloc.h"
 #include "threads/malloc.h"
 #include "userprog/process.h"
+#include "userprog/futex.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/directory.h"
@@ -47,9 +50,9 @@ void s_file_close(struct file *file){		//synchronized file closing provided for
 static bool isKernelAddrs(uint64_t uaddr, uint64_t size);
 static void validateBuffer(uint64_t uaddr, uint64_t size);
 static void validateAddress(uint64_t uaddr);
+static void validateFutex(uint64_t uaddr);
 static int allocate_fd(void);
-static struct fd_cont *allocate_fd_cont(void);
-static void free_fd_cont(struct fd_cont *cont);
+static struct fd_list *unlink_fd(struct fd_cont *cont, int fd);
 
 void
 syscall_init (void) {
@@ -61,6 +64,7 @@ syscall_init (void) {
 	 * until the syscall_entry swaps the userland stack to the kernel
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	sema_init(&file_access,1);
+	futex_init();
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
 }
@@ -77,6 +81,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	uint64_t callee_reg[6];
 	uintptr_t callee_rsp;
 	uint64_t ret;
+	enum intr_level old_level;
+	bool last;
+	int64_t ns;
 
 	cur->trsp = f->rsp;
 	switch(f->R.rax){
@@ -145,14 +152,14 @@ syscall_handler (struct intr_frame *f UNUSED) {
 				f->R.rax=-1;
 				break;
 			}else{
-				container = allocate_fd_cont();
+				container = fd_cont_alloc();
 				int fd = allocate_fd();
-				struct fd_list *fdl = (struct fd_list *)malloc(sizeof(struct fd_list));
+				struct fd_list *fdl = fd_list_alloc();
 				if(fdl==NULL){
 					sema_down(&file_access);
 					file_close(file);
 					sema_up(&file_access);
-					free_fd_cont(container);
+					fd_cont_free(container);
 					f->R.rax=-1;
 					break;
 				}
@@ -162,7 +169,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 				if(inode_type(file_get_inode(file))==INODE_DIR)
 					container->dir = dir_open(file_get_inode(file));
 				container->file=file;
-				list_push_back(&cur->fd_list,&container->elem);
+				old_level=intr_disable();	//fd table is shared with our other threads
+				list_push_back(&cur->proc->fd_list,&container->elem);
+				intr_set_level(old_level);
 				f->R.rax=fd;
 			}
 			break;
@@ -196,7 +205,7 @@ syscall_handler (struct intr_frame *f UNUSED) {
 					break;
 				}
 				struct page * pg;
-				if((pg = spt_find_page(&cur->spt,f->R.rsi)) == NULL){
+				if((pg = spt_find_page(&cur->proc->spt,f->R.rsi)) == NULL){
 					if(!(f->R.rsi > f->rsp-8 && f->R.rsi < USER_STACK))	//if not stack grow case, exit
 						thread_exit();
 				}else if(!pg->writable){	//write to writable
@@ -254,58 +263,68 @@ syscall_handler (struct intr_frame *f UNUSED) {
 			sema_up(&file_access);
 			break;
 		case SYS_CLOSE:
+			old_level=intr_disable();	//look up and unlink in one step, see SYS_OPEN
 			container = get_cont_by_fd(cur,f->R.rdi);
-			if(container==NULL)
+			if(container==NULL){
+				intr_set_level(old_level);
 				break;
-			fdl=list_front(&container->fdl);
-			while(list_entry(fdl,struct fd_list,elem)->fd != f->R.rdi)
-				fdl=list_next(fdl);
-			list_remove(fdl);
-			free(list_entry(fdl,struct fd_list,elem));
-			if(list_empty(&container->fdl)){
+			}
+			fdl=&unlink_fd(container,f->R.rdi)->elem;
+			last=list_empty(&container->fdl);
+			if(last)
+				list_remove(&container->elem);
+			intr_set_level(old_level);
+			fd_list_free(list_entry(fdl,struct fd_list,elem));
+			if(last){
 				if(inode_type(file_get_inode(container->file))==INODE_DIR)
 					free(container->dir);
 				sema_down(&file_access);
 				file_close(container->file);
 				sema_up(&file_access);
-				list_remove(&container->elem);
-				free_fd_cont(container);
+				fd_cont_free(container);
 			}
 			break;
 		case SYS_DUP2:
-			container = get_cont_by_fd(cur,f->R.rdi);
-			if(container==NULL){
-				f->R.rax=-1;
-				break;
-			}
 			if(f->R.rdi==f->R.rsi){
-				f->R.rax=f->R.rsi;
+				f->R.rax=get_cont_by_fd(cur,f->R.rdi)==NULL ? -1 : (int64_t)f->R.rsi;
 				break;
 			}
-			struct fd_list *fde=(struct fd_list *)malloc(sizeof(struct fd_list));//allocate new fd_list entry
+			struct fd_list *fde=fd_list_alloc();//allocate new fd_list entry
 			if(fde==NULL){
 				f->R.rax=-1;
 				break;
 			}
 
-			struct fd_cont * cont2=get_cont_by_fd(cur,f->R.rsi);
-			if(cont2!= NULL){		//when newfd was previously open, same as SYS_CLOSE
-				fdl=list_front(&cont2->fdl);
-				while(list_entry(fdl,struct fd_list, elem)->fd != f->R.rsi)
-					fdl=list_next(fdl);
-				list_remove(fdl);
-				free(list_entry(fdl,struct fd_list,elem));
-				if(list_empty(&cont2->fdl)){
-					sema_down(&file_access);
-					file_close(cont2->file);
-					sema_up(&file_access);
-					list_remove(&cont2->elem);
-					free_fd_cont(cont2);
+			struct fd_cont * cont2=NULL;
+			struct fd_list *old_fde=NULL;
+			old_level=intr_disable();	//see SYS_OPEN
+			container = get_cont_by_fd(cur,f->R.rdi);
+			if(container!=NULL){
+				cont2=get_cont_by_fd(cur,f->R.rsi);
+				if(cont2!= NULL){		//when newfd was previously open, same as SYS_CLOSE
+					old_fde=unlink_fd(cont2,f->R.rsi);
+					if(list_empty(&cont2->fdl))
+						list_remove(&cont2->elem);
+					else
+						cont2=NULL;
 				}
+				fde->fd=f->R.rsi;
+				list_push_back(&container->fdl,&fde->elem);	//add this fd to file description.
+			}
+			intr_set_level(old_level);
+			if(container==NULL){
+				fd_list_free(fde);
+				f->R.rax=-1;
+				break;
+			}
+			if(old_fde!=NULL)
+				fd_list_free(old_fde);
+			if(cont2!=NULL){
+				sema_down(&file_access);
+				file_close(cont2->file);
+				sema_up(&file_access);
+				fd_cont_free(cont2);
 			}
-
-			fde->fd=f->R.rsi;
-			list_push_back(&container->fdl,&fde->elem);	//add this fd to file description.
 
 			f->R.rax=f->R.rsi;
 			break;
@@ -382,6 +401,35 @@ syscall_handler (struct intr_frame *f UNUSED) {
 			f->R.rax = filesys_symlink((char *)f->R.rdi, (char *)f->R.rsi);
 			sema_up(&file_access);
 
+			break;
+		case SYS_THREAD_SPAWN:
+			if(!is_user_vaddr(f->R.rdi) || !is_user_vaddr(f->R.rdx)){
+				f->R.rax=TID_ERROR;
+				break;
+			}
+			f->R.rax = process_spawn(f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_THREAD_JOIN:
+			f->R.rax = process_join(f->R.rdi);
+			break;
+		case SYS_FUTEX_WAIT:
+			validateFutex(f->R.rdi);
+			f->R.rax = futex_wait((int *)f->R.rdi,f->R.rsi,f->R.rdx);
+			break;
+		case SYS_FUTEX_WAKE:
+			validateFutex(f->R.rdi);
+			f->R.rax = futex_wake((int *)f->R.rdi,f->R.rsi);
+			break;
+		case SYS_CLOCK_GETTIME:
+			validateBuffer(f->R.rsi,sizeof(struct timespec));
+			if(f->R.rdi!=CLOCK_MONOTONIC){
+				f->R.rax=-1;
+				break;
+			}
+			ns=timer_ns();
+			((struct timespec *)f->R.rsi)->tv_sec=ns/1000000000;
+			((struct timespec *)f->R.rsi)->tv_nsec=ns%1000000000;
+			f->R.rax=0;
 			break;
 		default:
 			thread_exit();
@@ -413,13 +461,23 @@ static void validateAddress(uint64_t uaddr){
 		thread_exit();
 	}
 }
+static void validateFutex(uint64_t uaddr){
+	validateAddress(uaddr);
+	if(uaddr%sizeof(int)!=0)
+		thread_exit();
+}
 static int allocate_fd(void){
 	struct thread *t=thread_current();
-	return t->num_fd++;
-}
-static struct fd_cont *allocate_fd_cont(void){
-	return (struct fd_cont *)malloc(sizeof(struct fd_cont));
+	enum intr_level old_level=intr_disable();
+	int fd=t->proc->num_fd++;
+	intr_set_level(old_level);
+	return fd;
 }
-static void free_fd_cont(struct fd_cont *cont){
-	free(cont);
+//remove fd from the descriptors sharing CONT and return its entry. interrupts must be off.
+static struct fd_list *unlink_fd(struct fd_cont *cont, int fd){
+	struct list_elem *e=list_front(&cont->fdl);
+	while(list_entry(e,struct fd_list,elem)->fd != fd)
+		e=list_next(e);
+	list_remove(e);
+	return list_entry(e,struct fd_list,elem);
 }
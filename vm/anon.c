@@ -1,12 +1,16 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdio.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
 #include "lib/kernel/bitmap.h"
 #include "lib/string.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
+#include "threads/palloc.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -23,15 +27,117 @@ static const struct page_operations anon_ops = {
 };
 //each page has 8 sectors
 #define NUM_SECTOR 8
+/* Most slots one swap-in reads ahead, counting its own. */
+#define SWAP_CLUSTER 8
+/* Pages in the swap cache. */
+#define SWAP_CACHE_CNT 16
 struct bitmap * swap_table;
 struct semaphore st_access;
+static size_t swap_cursor;	//next-fit hint into swap_table
+/* Number of pages referring to each swap slot.  A slot is shared
+   by the pages of a copy-on-write frame evicted as one, and by a
+   swapped-out page and its copies in fork children. */
+static uint16_t *swap_refs;
+/* Address space (pml4) of the page written to each slot, or a
+   null pointer if nothing was written.  Readahead stays within
+   the faulting page's address space. */
+static uint64_t **swap_owner;
+/* Bumped each time a slot is allocated, so that a swap cache
+   entry can tell its slot has since been reused. */
+static uint32_t *swap_gen;
+
+/* Swap cache: slots read ahead by swap-in, kept until their pages
+   fault or the entry is replaced, oldest first. */
+struct swap_cache_entry {
+	size_t slot;		/* Slot held, or SIZE_MAX if none. */
+	uint32_t gen;		/* swap_gen[slot] when it was read. */
+	void *kva;			/* Page holding the slot's contents. */
+};
+static struct swap_cache_entry swap_cache[SWAP_CACHE_CNT];
+static size_t swap_cache_hand;	//next entry to replace
+/* Guards swap_cache, including across the reads that fill it. */
+static struct lock swap_cache_lock;
+
+/* Statistics. */
+static long long swap_out_cnt;		//pages written
+static long long swap_write_cnt;	//disk commands writing them
+static long long readahead_cnt;		//pages read ahead
+static long long readahead_hit_cnt;	//of those, faulted in from the cache
+
+/* Cache of NUM_SECTOR-bit swap_status bitmaps.  Objects keep
+   their bitmap header across reuse; only the bits are cleared. */
+static struct kmem_cache *swap_status_cache;
+
+static void
+swap_status_ctor (void *obj) {
+	bitmap_create_in_buf (NUM_SECTOR, obj, bitmap_buf_size (NUM_SECTOR));
+}
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
+	size_t slot_cnt, i;
+	uint8_t *cache_pages;
+
 	swap_disk = disk_get(1,1);
-	swap_table = bitmap_create(disk_size(swap_disk)/8);
+	slot_cnt = disk_size(swap_disk)/NUM_SECTOR;
+	swap_table = bitmap_create(slot_cnt);
+	swap_refs = calloc(slot_cnt, sizeof *swap_refs);
+	swap_owner = calloc(slot_cnt, sizeof *swap_owner);
+	swap_gen = calloc(slot_cnt, sizeof *swap_gen);
+	if(swap_table == NULL || swap_refs == NULL || swap_owner == NULL
+			|| swap_gen == NULL)
+		PANIC("cannot allocate swap table");
 	sema_init(&st_access,1);
+	swap_status_cache = kmem_cache_create ("swap_status",
+			bitmap_buf_size (NUM_SECTOR), swap_status_ctor);
+
+	cache_pages = palloc_get_multiple(PAL_ASSERT, SWAP_CACHE_CNT);
+	for(i=0;i<SWAP_CACHE_CNT;i++){
+		swap_cache[i].slot = SIZE_MAX;
+		swap_cache[i].kva = cache_pages + i*PGSIZE;
+	}
+	lock_init(&swap_cache_lock);
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap: %lld pages out in %lld writes, "
+			"%lld read ahead, %lld readahead hits\n",
+			swap_out_cnt, swap_write_cnt, readahead_cnt, readahead_hit_cnt);
+}
+
+/* Allocates CNT contiguous swap slots, each with a single
+   reference, and returns the first one, or BITMAP_ERROR if there
+   is no such run. */
+static size_t
+swap_slots_get (size_t cnt) {
+	size_t slot, i;
+
+	sema_down(&st_access);
+	slot = bitmap_scan_and_flip_next(swap_table,&swap_cursor,cnt,false);
+	if(slot != BITMAP_ERROR)
+		for(i=slot;i<slot+cnt;i++){
+			swap_refs[i] = 1;
+			swap_owner[i] = NULL;
+			swap_gen[i]++;
+		}
+	sema_up(&st_access);
+	return slot;
+}
+
+/* Drops a reference to the swap slot starting at sector IDX,
+   freeing it with the last one. */
+static void
+swap_slot_put (size_t idx) {
+	size_t slot = idx / NUM_SECTOR;
+
+	sema_down(&st_access);
+	ASSERT(swap_refs[slot] > 0);
+	if(--swap_refs[slot] == 0)
+		bitmap_reset(swap_table, slot);
+	sema_up(&st_access);
 }
 
 /* Initialize the file mapping */
@@ -42,84 +148,208 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	
 	struct anon_page *anon_page = &page->anon;
 	anon_page->swap_idx = -1;
-	anon_page->swap_status = bitmap_create(NUM_SECTOR);
+	anon_page->swap_status = kmem_cache_alloc (swap_status_cache);
+	if (anon_page->swap_status == NULL)
+		return false;
+	bitmap_set_all (anon_page->swap_status, false);
 	return true;
 }
 
+/* Gives DST, an anonymous page with nothing swapped out, the same
+   contents on the swap disk as SRC: SRC's record of which sectors
+   hold data and, if SRC is swapped out, a reference to its slot.
+   Used for pages that shared a frame copy-on-write. */
+void
+anon_share_swap (struct page *dst, const struct page *src) {
+	const struct anon_page *from = &src->anon;
+	struct anon_page *to = &dst->anon;
+	size_t i;
+
+	ASSERT(to->swap_idx == (size_t) -1);
+	for(i=0;i<NUM_SECTOR;i++)
+		bitmap_set(to->swap_status,i,bitmap_test(from->swap_status,i));
+	if(from->swap_idx != (size_t) -1){
+		sema_down(&st_access);
+		swap_refs[from->swap_idx/NUM_SECTOR]++;
+		sema_up(&st_access);
+		to->swap_idx = from->swap_idx;
+	}
+}
+
+/* Returns the swap cache entry holding SLOT, or a null pointer.
+   Caller must hold swap_cache_lock, st_access and a reference to
+   SLOT. */
+static struct swap_cache_entry *
+swap_cache_find (size_t slot) {
+	size_t i;
+
+	for(i=0;i<SWAP_CACHE_CNT;i++)
+		if(swap_cache[i].slot == slot && swap_cache[i].gen == swap_gen[slot])
+			return &swap_cache[i];
+	return NULL;
+}
+
+/* Returns true if swap-in of a page of address space PML4 should
+   read SLOT ahead into the swap cache.  Caller must hold
+   st_access and swap_cache_lock. */
+static bool
+should_read_ahead (size_t slot, uint64_t *pml4) {
+	return slot < bitmap_size(swap_table) && bitmap_test(swap_table, slot)
+		&& swap_owner[slot] == pml4 && swap_cache_find(slot) == NULL;
+}
+
+/* Reads SLOT, which PAGE refers to, into KVA with one disk
+   command that also reads neighboring slots written from PAGE's
+   address space into the swap cache.  Pages evicted together get
+   consecutive slots in address order, so these are likely the
+   pages to fault next.  Caller must hold swap_cache_lock. */
+static void
+swap_read_cluster (struct page *page, size_t slot, void *kva) {
+	void *buffers[SWAP_CLUSTER * NUM_SECTOR];
+	size_t first = slot, last = slot, s, i;
+
+	sema_down(&st_access);
+	while(last - first + 1 < SWAP_CLUSTER && should_read_ahead(last + 1, page->pml4))
+		last++;
+	while(last - first + 1 < SWAP_CLUSTER && first > 0
+			&& should_read_ahead(first - 1, page->pml4))
+		first--;
+	for(s=first;s<=last;s++){
+		uint8_t *dst = kva;
+		if(s != slot){
+			struct swap_cache_entry *e = &swap_cache[swap_cache_hand];
+			swap_cache_hand = (swap_cache_hand + 1) % SWAP_CACHE_CNT;
+			e->slot = s;
+			e->gen = swap_gen[s];
+			dst = e->kva;
+			readahead_cnt++;
+		}
+		for(i=0;i<NUM_SECTOR;i++)
+			buffers[(s - first)*NUM_SECTOR + i] = dst + i*DISK_SECTOR_SIZE;
+	}
+	sema_up(&st_access);
+	disk_read_multiple(swap_disk, first*NUM_SECTOR, buffers,
+			(last - first + 1)*NUM_SECTOR);
+}
+
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
-	size_t i;
+	size_t slot;
 	if(anon_page->swap_idx == -1){
 		//memset(kva,0,PGSIZE);		//if no swap disk allocated, can be considered as zero page. or maybe not
 		//return true;
 		return false;
 	}
-	/* 
-	   swap index -1 means no swap disk allocatded.
-	  swap index should be multiple of 8
-	  because PGSIZE is 4096byte, sector size is 512
-	
-	if(anon_page->swap_idx % NUM_SECTOR)								   
-		return false;
-	*/
-	for(i=0;i<8;i++){
-		if(bitmap_test(anon_page->swap_status,i))
-			disk_read(swap_disk, anon_page->swap_idx + i, kva + i*DISK_SECTOR_SIZE);
-		else
-			memset(kva + i*DISK_SECTOR_SIZE,0, DISK_SECTOR_SIZE);
+	slot = anon_page->swap_idx / NUM_SECTOR;
+	if(!bitmap_any(anon_page->swap_status, 0, NUM_SECTOR))
+		memset(kva, 0, PGSIZE);		//zero page: nothing was written
+	else{
+		struct swap_cache_entry *e;
+
+		lock_acquire(&swap_cache_lock);
+		sema_down(&st_access);
+		e = swap_cache_find(slot);
+		sema_up(&st_access);
+		if(e != NULL){
+			memcpy(kva, e->kva, PGSIZE);
+			readahead_hit_cnt++;
+			e->slot = SIZE_MAX;
+		}else
+			swap_read_cluster(page, slot, kva);
+		lock_release(&swap_cache_lock);
 	}
-	bitmap_set(swap_table, anon_page->swap_idx/8, false);
+	swap_slot_put(anon_page->swap_idx);
 	
-	pml4_set_accessed(page->pml4,kva,false);
-	pml4_set_dirty(page->pml4,kva,false);
+	pml4_set_accessed(page->pml4,page->va,false);
+	pml4_set_dirty(page->pml4,page->va,false);
 	
 	anon_page->swap_idx = -1;	//now no allocation
 	return true;
 }
-/* check if page is zero page */
+
+/* Orders pages by address space, then by address. */
 static bool
-is_zeros(void * addr, size_t size){
-	unsigned char *va = addr;
-	ASSERT(va != NULL);
-	while(size-- > 0){
-		if( *va != 0)
-			return false;
-		va++;
-	}
-	return true;
+page_addr_less (const struct page *a, const struct page *b) {
+	if(a->pml4 != b->pml4)
+		return a->pml4 < b->pml4;
+	return a->va < b->va;
 }
 
+/* Writes the CNT resident pages in PAGES, which have consecutive
+   swap slots, with a single disk command.  Only then are the slots
+   marked with their owners, so that readahead never picks up a
+   slot whose contents are not on the disk yet. */
+static void
+swap_write_run (struct page *pages[], size_t cnt) {
+	const void *buffers[SWAP_CLUSTER * NUM_SECTOR];
+	size_t i, j;
 
-/* Swap out the page by writing contents to the swap disk. */
-static bool
-anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
-	size_t i;
-	/*if(is_zeropage(page->va)){	//check if page is all zero bytes
-		anon_page->swap_idx = -1;
-		return true;
-	}*/
+	if(cnt == 0)
+		return;
+	for(i=0;i<cnt;i++)
+		for(j=0;j<NUM_SECTOR;j++)	//through kva: PAGE may belong to another process
+			buffers[i*NUM_SECTOR + j] = pages[i]->frame->kva + j*DISK_SECTOR_SIZE;
+	disk_write_multiple(swap_disk, pages[0]->anon.swap_idx, buffers,
+			cnt*NUM_SECTOR);
 	sema_down(&st_access);
-	anon_page->swap_idx = bitmap_scan_and_flip(swap_table,0,1,false)*8;
+	for(i=0;i<cnt;i++)
+		swap_owner[pages[i]->anon.swap_idx/NUM_SECTOR] = pages[i]->pml4;
 	sema_up(&st_access);
-	if(anon_page->swap_idx == BITMAP_ERROR)
-		PANIC("no available space at swap disk");
-	if(pml4_is_dirty(page->pml4,page->va) || pml4_is_dirty(page->pml4,page->frame->kva)){	//if page is dirty, set swap status
-		for(i=0;i<8;i++){
-			if(!is_zeros(page->va+i*DISK_SECTOR_SIZE,DISK_SECTOR_SIZE)){
-				disk_write(swap_disk,anon_page->swap_idx + i,page->frame->kva + i*DISK_SECTOR_SIZE);
-				bitmap_mark(anon_page->swap_status,i);//set bit in swap_status
+	swap_out_cnt += cnt;
+	swap_write_cnt++;
+}
+
+/* Writes the CNT pages in PAGES, which must be resident and
+   initialized as anonymous pages, to the swap disk.  Pages are
+   given consecutive slots in address order (PAGES is sorted in
+   place), and each run of pages that are not all zeros is
+   written with a single disk command. */
+void
+anon_swap_out_many (struct page *pages[], size_t cnt) {
+	size_t i, j;
+
+	ASSERT(cnt <= SWAP_CLUSTER);
+
+	for(i=1;i<cnt;i++){	//insertion sort: CNT is small
+		struct page *p = pages[i];
+		for(j=i;j>0 && page_addr_less(p, pages[j-1]);j--)
+			pages[j] = pages[j-1];
+		pages[j] = p;
+	}
+
+	while(cnt > 0){
+		size_t n = cnt, slot, first = 0;
+
+		/* Take the longest run of free slots we can get. */
+		while((slot = swap_slots_get(n)) == BITMAP_ERROR)
+			if(n == 1)
+				PANIC("no available space at swap disk");
+			else
+				n /= 2;
+
+		for(i=0;i<n;i++){
+			struct anon_page *anon_page = &pages[i]->anon;
+
+			anon_page->swap_idx = (slot + i)*NUM_SECTOR;
+			if(page_is_zero(pages[i]->frame->kva)){	//nothing to write at all
+				bitmap_set_all(anon_page->swap_status,false);
+				swap_write_run(pages + first, i - first);
+				first = i + 1;
 			}else
-				bitmap_reset(anon_page->swap_status,i);//set bit in swap_status
-		}		
-	}else{
-		for(i=0;i<8;i++){
-			if(bitmap_test(anon_page->swap_status,i))
-				disk_write(swap_disk,anon_page->swap_idx + i,page->frame->kva + i*DISK_SECTOR_SIZE);
+				bitmap_set_all(anon_page->swap_status,true);
 		}
+		swap_write_run(pages + first, n - first);
+		pages += n;
+		cnt -= n;
 	}
+}
+
+/* Swap out the page by writing contents to the swap disk. */
+static bool
+anon_swap_out (struct page *page) {
+	anon_swap_out_many(&page, 1);
 	return true;
 }
 
@@ -127,8 +357,9 @@ anon_swap_out (struct page *page) {
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	if(anon_page->swap_idx != -1){	//if data is in swap disk, free them by changing swap table
-		bitmap_set(swap_table, anon_page->swap_idx/8, false);
+	vm_release_frame(page);
+	if(anon_page->swap_idx != -1){	//if data is in swap disk, drop our reference to it
+		swap_slot_put(anon_page->swap_idx);
 	}
-	bitmap_destroy(anon_page->swap_status);
+	kmem_cache_free (swap_status_cache, anon_page->swap_status);
 }
@@ -5,6 +5,7 @@
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "userprog/process.h"
 
 static bool file_map_swap_in (struct page *page, void *kva);
 static bool file_map_swap_out (struct page *page);
@@ -32,6 +33,7 @@ file_map_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	return true;
 }
 
 /* check if dirty */
@@ -50,8 +52,8 @@ file_map_swap_in (struct page *page, void *kva) {
 	file_read_at(file_page->file, kva, file_page->page_read_bytes, file_page->ofs);
 	sema_up(&file_access);
 	memset(kva + file_page->page_read_bytes, 0, PGSIZE-file_page->page_read_bytes);
-	pml4_set_accessed(page->pml4,kva,false);
-	pml4_set_dirty(page->pml4,kva,false);
+	pml4_set_accessed(page->pml4,page->va,false);
+	pml4_set_dirty(page->pml4,page->va,false);
 	return true;
 }
 
@@ -72,6 +74,7 @@ static void
 file_map_destroy (struct page *page) {
 	struct file_page *file_page = &page->file;
 	swap_out(page);
+	vm_release_frame(page);
 	(*file_page->mmap_count)--;
 	if((*file_page->mmap_count)==0){
 		sema_down(&file_access);
@@ -169,7 +172,7 @@ do_mmap (void *addr, size_t length, int writable,
 /* Do the munmap */
 void
 do_munmap (void *addr) {
-	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct supplemental_page_table *spt = &thread_current()->proc->spt;
 	struct page * fp = spt_find_page(spt, addr);
 	bool left = true;
 	size_t pgnum = 1;
@@ -179,10 +182,6 @@ do_munmap (void *addr) {
 				left = false;
 			}
 			destroy(fp);
-			if(fp->frame){
-				fp->frame->page = NULL;
-				pml4_clear_page(fp->pml4,fp->va);
-			}
 			spt_remove_page(spt, fp);
 			fp = spt_find_page(spt, addr + pgnum*PGSIZE);
 			pgnum++;
@@ -68,4 +68,5 @@ uninit_destroy (struct page *page) {
 	if(uninit->type & VM_FILE){
 		free(uninit->aux);
 	}
+	vm_release_frame(page);	//claimed, but failed to initialize
 }
@@ -1,16 +1,28 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
 #include <hash.h>
+#include <round.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "userprog/process.h"
+
+/* Most frames one eviction takes, and how far the clock hand
+   looks for each frame after the first. */
+#define EVICT_CNT 8
+#define EVICT_SCAN 32
 
 struct frame_table ft;
-struct semaphore ft_access;
+struct lock ft_lock;
+static struct condition ft_evicted;	//signaled when an eviction completes
+
+/* Object cache for struct page. */
+static struct kmem_cache *page_cache;
 
 /*  hash helper functions */
 
@@ -50,9 +62,22 @@ vm_init (void) {
 	/* TODO: Your code goes here. */
 
 	
-	list_init(&ft.ft_hash);
-	ft.hand = list_head(&ft.ft_hash);
-	sema_init(&ft_access,1);
+	void *base;
+	size_t i;
+
+	palloc_user_pool(&base, &ft.cnt);
+	ft.base = base;
+	ft.frames = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP(ft.cnt * sizeof *ft.frames, PGSIZE));
+	for(i = 0; i < ft.cnt; i++){
+		ft.frames[i].kva = ft.base + i * PGSIZE;
+		list_init(&ft.frames[i].pages);
+	}
+	ft.hand = 0;
+	ft.spread = ft.cnt / 4;
+	lock_init(&ft_lock);
+	cond_init(&ft_evicted);
+	page_cache = kmem_cache_create("page", sizeof(struct page), NULL);
 }
 
 
@@ -71,8 +96,11 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (size_t steps);
 static bool vm_do_claim_page (struct page *page);
+static bool vm_map_frame (struct page *, struct frame *);
+static bool is_fresh_anon (const struct page *, const struct page *);
+static bool vm_claim_large (struct supplemental_page_table *, struct page *);
 static struct frame *vm_evict_frame (void);
 
 /* Create the pending page object with initializer. If you want to create a
@@ -84,7 +112,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
-	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct supplemental_page_table *spt = &thread_current ()->proc->spt;
 	struct page *page = NULL;
 	
 
@@ -93,7 +121,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		/* TODO: Create the page, fetch the initialier according to the VM type,
 		 * TODO: and then create "uninit" page struct by calling uninit_new. You
 		 * TODO: should modify the field after calling the uninit_new. */
-		page = (struct page *)malloc(sizeof(struct page));
+		page = kmem_cache_alloc(page_cache);
 		if(page == NULL) goto err;
 		switch(VM_TYPE(type)){
 			case VM_ANON:
@@ -148,90 +176,237 @@ spt_insert_page (struct supplemental_page_table *spt,
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	hash_delete(&spt->spt_hash, &page->elem);
-	free(page);
+	kmem_cache_free(page_cache, page);
+}
+
+/* Returns the frame holding kernel virtual address KVA, which
+   must be in the user pool. */
+static struct frame *
+frame_of (void *kva) {
+	size_t idx = ((uint8_t *) kva - ft.base) / PGSIZE;
+
+	ASSERT (idx < ft.cnt);
+	return &ft.frames[idx];
+}
+
+/* Makes PAGE one of the pages mapping FRAME.  Caller must hold
+   ft_lock. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	page->frame = frame;
+	if (frame->page == NULL)
+		frame->page = page;
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+}
+
+/* Takes PAGE off FRAME, passing swap-out duty on to another page
+   if PAGE had it.  Caller must hold ft_lock. */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	list_remove (&page->frame_elem);
+	frame->ref_cnt--;
+	page->frame = NULL;
+	if (frame->page == page)
+		frame->page = list_empty (&frame->pages) ? NULL
+			: list_entry (list_front (&frame->pages), struct page, frame_elem);
+}
+
+/* Gives FRAME back to the user pool if no page maps it and no one
+   has it pinned.  Caller must hold ft_lock. */
+static void
+frame_put (struct frame *frame) {
+	if (frame->ref_cnt == 0 && frame->pin_cnt == 0) {
+		frame->flags &= ~FRAME_USED;
+		palloc_free_page (frame->kva);
+	}
+}
+
+/* Unpins FRAME, which vm_get_frame() returned pinned. */
+static void
+frame_unpin (struct frame *frame) {
+	lock_acquire(&ft_lock);
+	ASSERT (frame->pin_cnt > 0);
+	frame->pin_cnt--;
+	frame_put (frame);
+	lock_release(&ft_lock);
+}
+
+/* Waits until PAGE's frame, if any, is not being evicted.
+   Caller must hold ft_lock. */
+static void
+wait_for_eviction (struct page *page) {
+	while (page->frame != NULL && (page->frame->flags & FRAME_EVICTING))
+		cond_wait(&ft_evicted, &ft_lock);
 }
 
 /* helper function for vm_get_victim. 
-   check if one of pages refering frame has accessed frame */
-static bool is_frame_accessed(const struct frame *frame){
-	uint64_t *pml4 = frame->page->pml4;
-	return (pml4_is_accessed(pml4,frame->kva) || pml4_is_accessed(pml4,frame->page->va));
+   check if one of pages refering frame has accessed frame.
+   Only user mappings are looked at: the kernel maps the user pool
+   with 2 MB pages, whose accessed bit covers 512 frames at once. */
+static bool is_frame_accessed(struct frame *frame){
+	for (struct list_elem *e = list_begin (&frame->pages);
+			e != list_end (&frame->pages); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_accessed(page->pml4,page->va))
+			return true;
+	}
+	return false;
 }
-static void set_frame_accessed_zero(const struct frame *frame){
-	uint64_t *pml4 = frame->page->pml4;
-	pml4_set_accessed(pml4,frame->kva,false);
-	pml4_set_accessed(pml4,frame->page->va,false);
+static void set_frame_accessed_zero(struct frame *frame){
+	for (struct list_elem *e = list_begin (&frame->pages);
+			e != list_end (&frame->pages); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		pml4_set_accessed(page->pml4,page->va,false);
+	}
+}
+
+/* Returns true if FRAME holds a page and may be evicted. */
+static bool
+is_evictable (const struct frame *frame) {
+	return (frame->flags & FRAME_USED) && frame->pin_cnt == 0
+		&& frame->page != NULL;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted, or a null pointer
+   if none is found in STEPS steps of the hand.  Caller must hold
+   ft_lock.
+   policy : two-handed clock.  The front hand clears accessed bits
+   and the back hand, ft.spread frames behind, takes the first
+   frame not accessed since.  After two turns without a victim,
+   frames in constant use no longer keep the back hand going: it
+   takes the next frame that can be evicted at all. */
 static struct frame *
-vm_get_victim (void) {
-	//struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-	/* policy : FIFO */
-	struct frame * candidate;
-	while(true){
-		ft.hand = list_next(ft.hand);
-		if(ft.hand==list_tail(&ft.ft_hash)){	//if last element of hash
-			ft.hand = list_begin(&ft.ft_hash);	//goto first element and find again
-		}
-		candidate = list_entry(ft.hand, struct frame, elem);
-		if(is_frame_accessed(candidate)){
-			set_frame_accessed_zero(candidate);
-		}else{
-			return candidate;
-		}
-		if(candidate->page == NULL){
-			return candidate;
-		}
+vm_get_victim (size_t steps) {
+	struct frame *front, *back;
+	size_t i;
+
+	for(i = 0; i < steps; i++){
+		front = &ft.frames[(ft.hand + ft.spread) % ft.cnt];
+		back = &ft.frames[ft.hand];
+		ft.hand = (ft.hand + 1) % ft.cnt;
+
+		if(is_evictable(front))
+			set_frame_accessed_zero(front);
+		if(is_evictable(back) && (i >= 2 * ft.cnt || !is_frame_accessed(back)))
+			return back;
 	}
+	return NULL;
+}
+
+/* Gives each page mapping FRAME a 4 kB page table entry of its
+   own, so that it can be unmapped alone.  Returns false if a
+   large page could not be split.  Caller must hold ft_lock. */
+static bool
+frame_split (struct frame *frame) {
+	for (struct list_elem *e = list_begin (&frame->pages);
+			e != list_end (&frame->pages); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (!pml4_split_page (page->pml4, page->va))
+			return false;
+	}
+	return true;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Like vm_get_victim(), but splits the victim's large pages, as
+   eviction unmaps its pages one by one.  Passes over frames
+   whose large page cannot be split, giving up after TRIES of
+   them.  Caller must hold ft_lock. */
+static struct frame *
+vm_get_split_victim (size_t steps, size_t tries) {
+	struct frame *victim;
+
+	while ((victim = vm_get_victim (steps)) != NULL && !frame_split (victim))
+		if (--tries == 0)
+			return NULL;
+	return victim;
+}
+
+/* Evict frames and return one of them, pinned.  Along with the
+ * frame the caller needs, up to EVICT_CNT - 1 more anonymous
+ * frames the clock finds idle within EVICT_SCAN steps each are
+ * evicted and freed, so that their pages go to swap in one
+ * write.  Panics if there is nothing to evict. */
 static struct frame *
 vm_evict_frame (void) {
-	sema_down(&ft_access);
-	struct frame *victim = vm_get_victim ();
-	sema_up(&ft_access);
-	/* TODO: swap out the victim and return the evicted frame. */
-	if(victim->page != NULL){
-		swap_out(victim->page);
-		pml4_clear_page(victim->page->pml4,victim->page->va);
-		victim->page->frame = NULL;
+	struct frame *victims[EVICT_CNT], *victim;
+	struct page *owners[EVICT_CNT], *anon[EVICT_CNT];
+	size_t cnt = 0, anon_cnt = 0, i;
+
+	lock_acquire(&ft_lock);
+	victim = vm_get_split_victim (3 * ft.cnt, ft.cnt);
+	if(victim == NULL)
+		PANIC("no frame to evict: all are pinned");
+	for(i = 0; i < EVICT_CNT; i++){
+		if(i > 0){
+			victim = vm_get_split_victim (EVICT_SCAN, 1);
+			if(victim == NULL)
+				break;
+			if(VM_TYPE(victim->page->operations->type) != VM_ANON)
+				continue;
+		}
+		victim->pin_cnt++;
+		victim->flags |= FRAME_EVICTING;
+		victims[cnt] = victim;
+		owners[cnt++] = victim->page;
+	}
+	lock_release(&ft_lock);
+
+	/* Write the contents out once, through each frame's owner; the
+	   other pages sharing the frame take a reference to its slot.
+	   FRAME_EVICTING keeps them all from being destroyed. */
+	for(i = 0; i < cnt; i++)
+		if(VM_TYPE(owners[i]->operations->type) == VM_ANON)
+			anon[anon_cnt++] = owners[i];
+		else
+			swap_out(owners[i]);
+	if(anon_cnt > 0)
+		anon_swap_out_many(anon, anon_cnt);
+
+	lock_acquire(&ft_lock);
+	for(i = 0; i < cnt; i++){
+		victim = victims[i];
+		while(!list_empty(&victim->pages)){
+			struct page *page = list_entry(list_pop_front(&victim->pages),
+					struct page, frame_elem);
+			if(!pml4_clear_page(page->pml4,page->va))
+				NOT_REACHED();	//split when chosen
+			page->frame = NULL;
+			if(page != owners[i])
+				anon_share_swap(page, owners[i]);
+		}
 		victim->page = NULL;
+		victim->ref_cnt = 0;
+		victim->flags &= ~FRAME_EVICTING;
+		if(i > 0){
+			victim->pin_cnt--;
+			frame_put(victim);
+		}
 	}
-	return victim;
+	cond_broadcast(&ft_evicted, &ft_lock);
+	lock_release(&ft_lock);
+	return victims[0];
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is returned pinned, so that it is not evicted before
+ * the caller has mapped and filled it and called frame_unpin(). */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
 	void * ppage = palloc_get_page(PAL_USER);
-	struct hash_elem *chk;
 	if(ppage == NULL){
 		frame = vm_evict_frame();
 	}else{
-		frame = (struct frame *)malloc(sizeof(struct frame));
-		if(frame == NULL){
-			PANIC("todo?");
-		}
-		frame->kva = ppage;
-		frame->page = NULL;
-
-		sema_down(&ft_access);
-		list_push_back(&ft.ft_hash, &frame->elem);
-		sema_up(&ft_access);
-		/*
-		if(chk != NULL){
-			free(frame);
-			frame = hash_entry(chk, struct frame, elem);
-		}	*/
+		frame = frame_of(ppage);
+		lock_acquire(&ft_lock);
+		ASSERT (!(frame->flags & FRAME_USED));
+		frame->flags |= FRAME_USED;
+		frame->pin_cnt = 1;
+		lock_release(&ft_lock);
 	}
 
 	ASSERT (frame != NULL);
@@ -252,23 +427,65 @@ vm_stack_growth (void *addr) {
 	}
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page, that is, the first
+   write to a page that fork() left sharing its frame.  The last
+   page on a frame just makes it writable again; any other gets a
+   copy of its own. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
-	return true;
+vm_handle_wp (struct page *page) {
+	struct frame *frame, *shared;
+	bool success;
+
+	lock_acquire(&ft_lock);
+	wait_for_eviction(page);
+	shared = page->frame;
+	if(shared == NULL){
+		/* Evicted before we got here: read it back in, into a
+		   frame that is PAGE's alone. */
+		lock_release(&ft_lock);
+		return vm_do_claim_page(page);
+	}
+	if(shared->ref_cnt == 1){
+		success = pml4_set_writable(page->pml4, page->va, true);
+		lock_release(&ft_lock);
+		return success;
+	}
+	shared->pin_cnt++;
+	lock_release(&ft_lock);
+
+	frame = vm_get_frame ();
+	copy_page(frame->kva, shared->kva);
+	lock_acquire(&ft_lock);
+	if(!pml4_clear_page(page->pml4, page->va)){
+		shared->pin_cnt--;
+		frame_put(shared);
+		lock_release(&ft_lock);
+		frame_unpin(frame);
+		return false;
+	}
+	frame_unlink(shared, page);
+	shared->pin_cnt--;
+	frame_put(shared);
+	lock_release(&ft_lock);
+
+	success = vm_map_frame(page, frame);
+	frame_unpin(frame);
+	return success;
 }
 
 /* Return true on success */
 bool
 vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct supplemental_page_table *spt;
 	struct page *page = NULL;
 	/* TODO: Validate the fault */
 	/* TODO: Your code goes here */
 	uintptr_t rsp;
 //	printf("fault: %x %d %d %d\n\n", addr, user,write,not_present);
 	if(user && is_kernel_vaddr(addr)) thread_exit();
+	if(thread_current()->proc == NULL) return false;	//kernel thread
+	spt = &thread_current ()->proc->spt;
 	page = spt_find_page(spt,addr);
 	if(page==NULL){
 		if(user){		//user case rsp setting
@@ -293,6 +510,8 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
 		}
 		return false; //otherwise should not happen
 	}
+	if (is_fresh_anon (page, page) && vm_claim_large (spt, page))
+		return true;
 	return vm_do_claim_page (page);
 }
 
@@ -301,7 +520,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	kmem_cache_free (page_cache, page);
 }
 
 /* Claim the page that allocate on VA. */
@@ -312,7 +531,7 @@ vm_claim_page (void *va) {
 	struct hash_elem *e;
 	struct page p;
 	p.va = va;
-	e = hash_find(&thread_current()->spt.spt_hash,&p.elem);
+	e = hash_find(&thread_current()->proc->spt.spt_hash,&p.elem);
 	if(e==NULL) return false;
 	else{
 		page = hash_entry(e, struct page, elem);
@@ -320,18 +539,155 @@ vm_claim_page (void *va) {
 	}
 }
 
+/* Number of pages in a large page. */
+#define LARGE_PAGE_CNT (LARGE_PGSIZE / PGSIZE)
+
+/* Returns true if PAGE is an anonymous page of the same kind as
+   FIRST that has never been claimed. */
+static bool
+is_fresh_anon (const struct page *page, const struct page *first) {
+	return page != NULL && page->frame == NULL
+		&& page->operations->type == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->writable == first->writable
+		&& page->pml4 == first->pml4;
+}
+
+/* Tries to claim PAGE together with the rest of its 2 MB aligned
+   region, backed by 512 contiguous frames and mapped by a single
+   large-page entry to spare the TLB.  The region qualifies only
+   if every page in it is an anonymous page that has never been
+   claimed and it has no page table yet, and only if the user pool
+   has a free 2 MB block: this never evicts to make one.  The
+   large page is split back into 4 kB entries when any of its
+   pages is evicted or unmapped.  Returns false, having changed
+   nothing, if the region does not qualify. */
+static bool
+vm_claim_large (struct supplemental_page_table *spt, struct page *page) {
+	uint8_t *base = (uint8_t *) ((uintptr_t) page->va & ~LARGE_PGMASK);
+	uint8_t *kva;
+	size_t i;
+	bool success = true;
+
+	for (i = 0; i < LARGE_PAGE_CNT; i++)
+		if (!is_fresh_anon (spt_find_page (spt, base + i * PGSIZE), page))
+			return false;
+
+	kva = palloc_get_multiple (PAL_USER, LARGE_PAGE_CNT);
+	if (kva == NULL)
+		return false;
+	if ((vtop (kva) & LARGE_PGMASK) != 0
+			|| !pml4_set_large_page (page->pml4, base, kva, page->writable)) {
+		palloc_free_multiple (kva, LARGE_PAGE_CNT);
+		return false;
+	}
+
+	/* Set links, then initialize each page as its own claim
+	   would, keeping the frames pinned until they are filled. */
+	lock_acquire (&ft_lock);
+	for (i = 0; i < LARGE_PAGE_CNT; i++) {
+		struct frame *frame = frame_of (kva + i * PGSIZE);
+
+		frame->flags |= FRAME_USED;
+		frame->pin_cnt = 1;
+		frame_link (frame, spt_find_page (spt, base + i * PGSIZE));
+	}
+	lock_release (&ft_lock);
+
+	for (i = 0; i < LARGE_PAGE_CNT; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		if (!swap_in (p, p->frame->kva))
+			success = false;
+	}
+	for (i = 0; i < LARGE_PAGE_CNT; i++)
+		frame_unpin (frame_of (kva + i * PGSIZE));
+	return success;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
 	struct frame *frame = vm_get_frame ();
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	bool success;
 	//printf("addr: %x %x %x\n", page->va,frame->kva,USER_STACK );
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	if(!pml4_set_page(page->pml4,page->va,frame->kva,page->writable))
-		return false;
-	return swap_in (page, frame->kva);
+	success = vm_map_frame (page, frame) && swap_in (page, frame->kva);
+	frame_unpin (frame);
+	return success;
+}
+
+/* Links PAGE to FRAME, a pinned frame no other page maps, and
+   inserts the page table entry mapping PAGE's VA to FRAME's PA. */
+static bool
+vm_map_frame (struct page *page, struct frame *frame) {
+	/* Set links */
+	lock_acquire(&ft_lock);
+	frame_link (frame, page);
+	lock_release(&ft_lock);
+	return pml4_set_page(page->pml4,page->va,frame->kva,page->writable);
+}
+
+/* Pins PAGE's frame and returns it, or returns a null pointer if
+   PAGE is not resident. */
+static struct frame *
+pin_resident (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire(&ft_lock);
+	wait_for_eviction(page);
+	frame = page->frame;
+	if(frame != NULL)
+		frame->pin_cnt++;
+	lock_release(&ft_lock);
+	return frame;
+}
+
+/* Makes PAGE, a fresh anonymous page in the current process,
+   share SRC's contents: its frame if it is resident, else its
+   swap slot.  A shared frame is mapped read-only on both sides,
+   so that either side's next write faults into vm_handle_wp.
+   PAGE keeps SRC's dirty bit, since either may be the one to swap
+   the frame out. */
+static bool
+vm_share_page (struct page *page, struct page *src) {
+	struct frame *frame;
+	bool success = true;
+
+	lock_acquire(&ft_lock);
+	wait_for_eviction(src);
+	anon_share_swap(page, src);
+	frame = src->frame;
+	if(frame != NULL){
+		bool dirty = pml4_is_dirty(src->pml4, src->va);
+
+		success = (!src->writable || pml4_set_writable(src->pml4, src->va, false))
+			&& pml4_set_page(page->pml4, page->va, frame->kva, false);
+		if(success){
+			pml4_set_dirty(page->pml4, page->va, dirty);
+			frame_link(frame, page);
+		}
+	}
+	lock_release(&ft_lock);
+	return success;
+}
+
+/* Unmaps PAGE from its frame, if it has one.  The frame goes back
+   to the user pool once no other page shares it.  Large pages are
+   released only with the rest of their address space, so if one
+   cannot be split, it is unmapped as a whole. */
+void
+vm_release_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire(&ft_lock);
+	wait_for_eviction(page);
+	frame = page->frame;
+	if(frame != NULL){
+		if(!pml4_clear_page(page->pml4, page->va))
+			pml4_clear_large_page(page->pml4, page->va);
+		frame_unlink (frame, page);
+		frame_put (frame);
+	}
+	lock_release(&ft_lock);
 }
 
 
@@ -341,14 +697,20 @@ supplemental_page_table_init (struct supplemental_page_table *spt) {
 	hash_init(&spt->spt_hash, spt_hash_func, spt_less_func,NULL);
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.
+   Anonymous pages are shared copy-on-write: a resident one shares
+   its frame, a swapped-out one its swap slot, and neither is
+   copied until one side writes to it.  Pages of mmap'd files are
+   copied eagerly, since each mapping writes back to the file on
+   its own. */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src) {
 	struct hash_iterator i;
 	struct page * page;
+	struct frame *frame, *src_frame;
 	void * upage;
-	bool writable;
+	bool writable, succ;
 	enum vm_type type;
 	hash_first(&i, &src->spt_hash);
 	while(hash_next(&i)){
@@ -359,7 +721,7 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 		/* Check wheter the upage is already occupied or not. */
 
 		if (spt_find_page (dst, upage) == NULL) {
-			page = (struct page *)malloc(sizeof(struct page));
+			page = kmem_cache_alloc(page_cache);
 			if(page == NULL) goto err;
 			switch(VM_TYPE(type)){
 				case VM_ANON:
@@ -371,16 +733,37 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 				default:
 					PANIC("wrong vm_type");
 			}
+			lock_init(&page->pglock);
 			page->pml4 = thread_current()->pml4;
 			page->type = type;
 			page->writable = writable;
 			if(!spt_insert_page(dst, page))
 				goto err;
-			if(!vm_do_claim_page(page))
-				goto err;
-			if(spte->frame == NULL && !vm_do_claim_page(spte))
+			if(VM_TYPE(type) == VM_ANON){
+				if(spte->operations->type == VM_UNINIT && !vm_do_claim_page(spte))
+					goto err;
+				if(!anon_initializer(page, type, NULL))
+					goto err;
+				if(!vm_share_page(page, spte))
+					goto err;
+				continue;
+			}
+			frame = vm_get_frame();
+			while((src_frame = pin_resident(spte)) == NULL)
+				if(!vm_do_claim_page(spte)){
+					frame_unpin(frame);
+					goto err;
+				}
+			succ = vm_map_frame(page, frame) && swap_in(page, frame->kva);
+			if(succ){
+				copy_page(frame->kva, src_frame->kva);
+				page->file = spte->file;
+				(*page->file.mmap_count)++;
+			}
+			frame_unpin(src_frame);
+			frame_unpin(frame);
+			if(!succ)
 				goto err;
-			memcpy(page->frame->kva,spte->frame->kva,PGSIZE);
 		}
 	}
 	return true;
@@ -392,11 +775,15 @@ err:
 void
 free_hash_element(struct hash_elem *element, void *aux UNUSED){
 	struct page *spte = hash_entry(element, struct page, elem);
-	struct frame *frame = spte->frame;
-	
 	vm_dealloc_page(spte);
-	if(frame != NULL)
-		frame->page = NULL;
+}
+
+/* Unmaps the large page, if any, that holds the page at ELEMENT,
+   as a whole. */
+static void
+clear_large_mapping(struct hash_elem *element, void *aux UNUSED){
+	struct page *spte = hash_entry(element, struct page, elem);
+	pml4_clear_large_page(spte->pml4, spte->va);
 }
 
 /* Free the resource hold by the supplemental page table */
@@ -404,5 +791,8 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
+	/* Unmap large pages whole first: unmapping their pages one by
+	   one would split them, which takes memory we may not have. */
+	hash_apply(&spt->spt_hash, clear_large_mapping);
 	hash_clear(&spt->spt_hash, free_hash_element);
 }